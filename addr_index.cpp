@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <stdexcept>
+#include "addr_index.h"
+
+namespace iii{
+
+using std::vector;
+
+AddrIndex::AddrIndex(const ELF &elf)
+    :bias_(0)
+{
+    build(elf);
+}
+
+AddrIndex::AddrIndex(const ELF &elf, uint64_t load_base)
+    :bias_(loadBias(elf, load_base))
+{
+    build(elf);
+}
+
+uint64_t loadBias(const ELF &elf, uint64_t load_base)
+{
+    if(elf.e_type().value() != ET_DYN)
+        return 0;
+
+    // the load base is where the lowest page of the image was mapped
+    uint64_t min_vaddr = ~(uint64_t)0;
+    for(size_t i = 0; i < elf.e_phnum(); ++i){
+        const auto &phdr = elf.phdr(i);
+        if(phdr->p_type().value() != PT_LOAD)
+            continue;
+
+        uint64_t align = phdr->p_align() ? phdr->p_align() : 1;
+        min_vaddr = std::min(min_vaddr, phdr->p_vaddr() & ~(align - 1));
+    }
+    return min_vaddr == ~(uint64_t)0 ? 0 : load_base - min_vaddr;
+}
+
+// fill in the segment tables
+void AddrIndex::build(const ELF &elf)
+{
+    for(size_t i = 0; i < elf.e_phnum(); ++i){
+        const auto &phdr = elf.phdr(i);
+        if(phdr->p_type().value() == PT_LOAD && phdr->p_filesz() > 0)
+            by_vaddr_.push_back(Segment{phdr->p_vaddr(), phdr->p_offset(), phdr->p_filesz()});
+    }
+
+    by_offset_ = by_vaddr_;
+    std::sort(by_vaddr_.begin(), by_vaddr_.end(),
+            [](const Segment &a, const Segment &b){ return a.vaddr < b.vaddr; });
+    std::sort(by_offset_.begin(), by_offset_.end(),
+            [](const Segment &a, const Segment &b){ return a.offset < b.offset; });
+}
+
+uint64_t AddrIndex::vaddr_to_offset(uint64_t vaddr) const
+{
+    uint64_t addr = vaddr - bias_;
+    auto it = std::upper_bound(by_vaddr_.cbegin(), by_vaddr_.cend(), addr,
+            [](uint64_t a, const Segment &seg){ return a < seg.vaddr; });
+    if(it == by_vaddr_.cbegin())
+        return NOT_MAPPED;
+
+    --it;
+    if(addr - it->vaddr >= it->filesz)
+        return NOT_MAPPED;
+    return it->offset + (addr - it->vaddr);
+}
+
+uint64_t AddrIndex::offset_to_vaddr(uint64_t offset) const
+{
+    auto it = std::upper_bound(by_offset_.cbegin(), by_offset_.cend(), offset,
+            [](uint64_t o, const Segment &seg){ return o < seg.offset; });
+    if(it == by_offset_.cbegin())
+        return NOT_MAPPED;
+
+    --it;
+    if(offset - it->offset >= it->filesz)
+        return NOT_MAPPED;
+    return it->vaddr + (offset - it->offset) + bias_;
+}
+
+// one merge pass over by_vaddr_; vaddrs - bias_ must be ascending
+void AddrIndex::translate_run(const uint64_t *vaddrs, size_t n, uint64_t *offsets) const
+{
+    const Segment *seg = by_vaddr_.data();
+    const Segment *seg_end = seg + by_vaddr_.size();
+
+    for(size_t i = 0; i < n; ++i){
+        uint64_t addr = vaddrs[i] - bias_;
+        while(seg < seg_end && addr - seg->vaddr >= seg->filesz && addr >= seg->vaddr)
+            ++seg;
+
+        if(seg < seg_end && addr >= seg->vaddr)
+            offsets[i] = seg->offset + (addr - seg->vaddr);
+        else
+            offsets[i] = NOT_MAPPED;
+    }
+}
+
+void AddrIndex::vaddrs_to_offsets(const uint64_t *vaddrs, size_t n, uint64_t *offsets) const
+{
+    if(!std::is_sorted(vaddrs, vaddrs + n))
+        throw std::invalid_argument("vaddrs are not sorted");
+
+    // vaddr - bias wraps around (as in vaddr_to_offset) exactly for the
+    // vaddrs below the bias, which splits the input into two ascending runs
+    size_t split = std::lower_bound(vaddrs, vaddrs + n, bias_) - vaddrs;
+    translate_run(vaddrs, split, offsets);
+    translate_run(vaddrs + split, n - split, offsets + split);
+}
+
+void AddrIndex::offsets_to_vaddrs(const uint64_t *offsets, size_t n, uint64_t *vaddrs) const
+{
+    if(!std::is_sorted(offsets, offsets + n))
+        throw std::invalid_argument("offsets are not sorted");
+
+    const Segment *seg = by_offset_.data();
+    const Segment *seg_end = seg + by_offset_.size();
+
+    for(size_t i = 0; i < n; ++i){
+        uint64_t offset = offsets[i];
+        while(seg < seg_end && offset - seg->offset >= seg->filesz && offset >= seg->offset)
+            ++seg;
+
+        if(seg < seg_end && offset >= seg->offset)
+            vaddrs[i] = seg->vaddr + (offset - seg->offset) + bias_;
+        else
+            vaddrs[i] = NOT_MAPPED;
+    }
+}
+
+} //namespace end
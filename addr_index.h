@@ -0,0 +1,60 @@
+#ifndef __ADDR_INDEX_H
+#define __ADDR_INDEX_H 1
+
+#include <cstdint>
+#include <vector>
+#include "elf_bin.h"
+
+namespace iii{
+
+// Translation between virtual addresses and file offsets, built once from
+// the PT_LOAD program headers.
+//
+// Built without a load base, addresses are link-time addresses. Given the
+// runtime load base of an ET_DYN object (PIE, shared library), the bias is
+// subtracted before the lookup, so profiler PCs can be passed as-is.
+// Addresses that fall outside every segment, or inside the zero-filled
+// tail (p_filesz..p_memsz), translate to NOT_MAPPED.
+class AddrIndex{
+public:
+    static constexpr uint64_t NOT_MAPPED = ~(uint64_t)0;
+
+    // link-time addresses (bias 0)
+    explicit AddrIndex(const ELF &elf);
+
+    // runtime addresses of an image whose lowest page was mapped at load_base
+    AddrIndex(const ELF &elf, uint64_t load_base);
+
+    uint64_t bias() const { return bias_; }
+    size_t segments() const { return by_vaddr_.size(); }
+
+    uint64_t vaddr_to_offset(uint64_t vaddr) const;
+    uint64_t offset_to_vaddr(uint64_t offset) const;
+
+    // Batch forms: the input must be sorted ascending; the whole array is
+    // translated in one merge pass over the segments.
+    void vaddrs_to_offsets(const uint64_t *vaddrs, size_t n, uint64_t *offsets) const;
+    void offsets_to_vaddrs(const uint64_t *offsets, size_t n, uint64_t *vaddrs) const;
+
+private:
+    void build(const ELF &elf);
+    void translate_run(const uint64_t *vaddrs, size_t n, uint64_t *offsets) const;
+
+    struct Segment{
+        uint64_t vaddr;
+        uint64_t offset;
+        uint64_t filesz;
+    };
+
+    vector<Segment> by_vaddr_;
+    vector<Segment> by_offset_;
+    uint64_t bias_;
+};
+
+// What AddrIndex(elf, load_base) subtracts from runtime addresses: 0 for
+// fixed-address images, else load_base minus the lowest PT_LOAD page.
+uint64_t loadBias(const ELF &elf, uint64_t load_base);
+
+} //namespace end
+
+#endif
@@ -0,0 +1,186 @@
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <ar.h>
+#include "archive.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::map;
+
+static uint64_t parse_decimal(const char *field, size_t len)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < len && field[i] >= '0' && field[i] <= '9'; ++i)
+        value = value * 10 + (field[i] - '0');
+    return value;
+}
+
+static uint64_t load_be(const unsigned char *p, size_t width)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < width; ++i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// ar names are padded with spaces; GNU terminates short names with '/'
+static string trim_name(const char *name, size_t len)
+{
+    while(len > 0 && name[len-1] == ' ')
+        --len;
+    if(len > 0 && name[len-1] == '/')
+        --len;
+    return string(name, len);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool Archive::is_archive(const char *data, size_t size)
+{
+    return size >= SARMAG && memcmp(data, ARMAG, SARMAG) == 0;
+}
+
+Archive::Archive(const char *filename)
+{
+    auto file = std::make_shared<MappedFile>(filename);
+    bin_ = file->data();
+    size_ = file->size();
+    owner_ = move(file);
+    parse();
+}
+
+Archive::Archive(std::shared_ptr<const void> owner, const char *data, size_t size)
+    :owner_(move(owner)), bin_(data), size_(size)
+{
+    parse();
+}
+
+ELF Archive::elf(size_t i) const
+{
+    const ArMember &m = members_[i];
+    return ELF(owner_, bin_ + m.offset, m.size);
+}
+
+void Archive::for_each_member(const std::function<void(size_t, const ELF&)> &fn,
+        unsigned threads) const
+{
+    parallelFor(members_.size(), [&](size_t i){
+        try{
+            ELF e = elf(i);
+            fn(i, e);
+        }catch(std::invalid_argument&){
+            // not an ELF object (e.g. LLVM bitcode); nothing to do
+        }
+    }, threads);
+}
+
+void Archive::parse_symbol_index(const char *data, size_t size, size_t width,
+        vector<pair<string, uint64_t>> &entries) const
+{
+    const unsigned char *p = (const unsigned char*) data;
+    if(size < width)
+        throw std::invalid_argument("truncated archive symbol index");
+
+    uint64_t count = load_be(p, width);
+    if(count > (size - width) / width)
+        throw std::invalid_argument("truncated archive symbol index");
+
+    const char *names = data + width + count * width;
+    const char *names_end = data + size;
+    entries.reserve(count);
+    for(uint64_t i = 0; i < count && names < names_end; ++i){
+        uint64_t header = load_be(p + width + i * width, width);
+        const char *end = (const char*) memchr(names, '\0', names_end - names);
+        if(!end)
+            end = names_end;
+        entries.emplace_back(string(names, end - names), header);
+        names = end + 1;
+    }
+}
+
+void Archive::parse()
+{
+    const char *bin = bin_;
+    const size_t size = size_;
+
+    if(size >= SARMAG && memcmp(bin, "!<thin>\n", SARMAG) == 0)
+        throw std::invalid_argument("thin archives are not supported");
+    if(!is_archive(bin, size))
+        throw std::invalid_argument("invalid archive magic");
+
+    const char *longnames = nullptr;
+    size_t longnames_size = 0;
+    vector<pair<string, uint64_t>> index;
+    map<uint64_t, size_t> header_to_member;
+
+    uint64_t offset = SARMAG;
+    while(offset + sizeof(struct ar_hdr) <= size){
+        struct ar_hdr hdr;
+        memcpy(&hdr, bin + offset, sizeof(hdr));
+        if(memcmp(hdr.ar_fmag, ARFMAG, sizeof(hdr.ar_fmag)) != 0)
+            throw std::invalid_argument("invalid archive member header");
+
+        uint64_t data = offset + sizeof(hdr);
+        uint64_t data_size = parse_decimal(hdr.ar_size, sizeof(hdr.ar_size));
+        if(data_size > size - data)
+            throw std::invalid_argument("truncated archive member");
+
+        const char *name = hdr.ar_name;
+        const size_t name_len = sizeof(hdr.ar_name);
+
+        if(memcmp(name, "/ ", 2) == 0){
+            parse_symbol_index(bin + data, data_size, 4, index);
+        }else if(memcmp(name, "/SYM64/ ", 8) == 0){
+            parse_symbol_index(bin + data, data_size, 8, index);
+        }else if(memcmp(name, "// ", 3) == 0){
+            longnames = bin + data;
+            longnames_size = data_size;
+        }else if(memcmp(name, "__.SYMDEF", 9) == 0){
+            // BSD symbol table; members are found by walking the headers
+        }else{
+            ArMember member{string(), data, data_size};
+
+            if(name[0] == '/' && name[1] >= '0' && name[1] <= '9'){
+                // GNU long name: "/<offset into the // table>", ended by "/\n"
+                uint64_t pos = parse_decimal(name + 1, name_len - 1);
+                if(!longnames || pos >= longnames_size)
+                    throw std::invalid_argument("invalid archive long name");
+                const char *s = longnames + pos;
+                const char *end = s;
+                while(end < longnames + longnames_size && *end != '\n')
+                    ++end;
+                member.name = trim_name(s, end - s);
+            }else if(memcmp(name, "#1/", 3) == 0){
+                // BSD long name stored in front of the member data
+                uint64_t len = parse_decimal(name + 3, name_len - 3);
+                if(len > data_size)
+                    throw std::invalid_argument("invalid archive long name");
+                const char *s = bin + data;
+                member.name = string(s, strnlen(s, len));
+                member.offset += len;
+                member.size -= len;
+            }else{
+                member.name = trim_name(name, name_len);
+            }
+
+            header_to_member[offset] = members_.size();
+            members_.push_back(move(member));
+        }
+
+        // member data is padded to an even offset
+        offset = data + data_size + (data_size & 1);
+    }
+
+    symbols_.reserve(index.size());
+    for(auto &entry: index){
+        auto it = header_to_member.find(entry.second);
+        if(it != header_to_member.end())
+            symbols_.emplace_back(move(entry.first), it->second);
+    }
+}
+
+} //namespace end
@@ -0,0 +1,61 @@
+#ifndef __ARCHIVE_H
+#define __ARCHIVE_H 1
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "utils.h"
+#include "elf_bin.h"
+
+namespace iii{
+
+struct ArMember{
+    string name;
+    uint64_t offset;    // of the member data inside the archive
+    uint64_t size;
+};
+
+// Static (.a) archive read in place from a mapping of the whole file.
+// Understands the SysV/GNU layout (symbol index "/" or "/SYM64/",
+// long-name table "//") and BSD "#1/<len>" names.
+class Archive{
+public:
+    Archive(const char *filename);
+
+    // archive held in `size` bytes at `data`, kept alive by `owner`
+    Archive(std::shared_ptr<const void> owner, const char *data, size_t size);
+
+    static bool is_archive(const char *data, size_t size);
+
+    size_t size() const { return members_.size(); }
+    const ArMember &member(size_t i) const { return members_[i]; }
+
+    // (symbol, member index) pairs from the archive symbol index
+    const vector<std::pair<string, size_t>> &symbols() const { return symbols_; }
+
+    // ELF directly over the member bytes, sharing the archive mapping
+    ELF elf(size_t i) const;
+
+    // Parse every member on a pool of threads and call fn(i, elf) for each;
+    // members that are not ELF objects are skipped.
+    void for_each_member(const std::function<void(size_t, const ELF&)> &fn,
+            unsigned threads = 0) const;
+
+private:
+    void parse();
+    void parse_symbol_index(const char *data, size_t size, size_t width,
+            vector<std::pair<string, uint64_t>> &entries) const;
+
+    std::shared_ptr<const void> owner_;
+    const char *bin_;
+    size_t size_;
+    vector<ArMember> members_;
+    vector<std::pair<string, size_t>> symbols_;
+};
+
+} //namespace end
+
+#endif
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "eh_frame.h"
+
+namespace iii{
+
+using std::string;
+
+template<typename T>
+static T readRaw(const char *&p, const char *end)
+{
+    if((size_t)(end - p) < sizeof(T))
+        throw std::invalid_argument("truncated eh_frame data");
+    T t;
+    memcpy(&t, p, sizeof(t));
+    p += sizeof(t);
+    return t;
+}
+
+static uint64_t readUleb(const char *&p, const char *end)
+{
+    uint64_t value = 0;
+    unsigned shift = 0;
+    for(;;){
+        if(p >= end)
+            throw std::invalid_argument("truncated eh_frame data");
+        unsigned char byte = *p++;
+        if(shift < 64)
+            value |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+        if(!(byte & 0x80))
+            return value;
+    }
+}
+
+static int64_t readSleb(const char *&p, const char *end)
+{
+    int64_t value = 0;
+    unsigned shift = 0;
+    unsigned char byte;
+    do{
+        if(p >= end)
+            throw std::invalid_argument("truncated eh_frame data");
+        byte = *p++;
+        if(shift < 64)
+            value |= (int64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    }while(byte & 0x80);
+
+    if(shift < 64 && (byte & 0x40))
+        value |= -((int64_t)1 << shift);
+    return value;
+}
+
+uint64_t decodeEhPointer(uint8_t enc, const char *&p, const char *end,
+        uint64_t vaddr, uint64_t datarel, bool is64)
+{
+    if(enc == DW_EH_PE_omit)
+        throw std::invalid_argument("omitted eh_frame pointer");
+
+    uint64_t value;
+    switch(enc & 0x0f){
+    case DW_EH_PE_absptr:
+        value = is64 ? readRaw<uint64_t>(p, end) : readRaw<uint32_t>(p, end);
+        break;
+    case DW_EH_PE_uleb128: value = readUleb(p, end); break;
+    case DW_EH_PE_udata2:  value = readRaw<uint16_t>(p, end); break;
+    case DW_EH_PE_udata4:  value = readRaw<uint32_t>(p, end); break;
+    case DW_EH_PE_udata8:  value = readRaw<uint64_t>(p, end); break;
+    case DW_EH_PE_sleb128: value = readSleb(p, end); break;
+    case DW_EH_PE_sdata2:  value = (int64_t)readRaw<int16_t>(p, end); break;
+    case DW_EH_PE_sdata4:  value = (int64_t)readRaw<int32_t>(p, end); break;
+    case DW_EH_PE_sdata8:  value = readRaw<int64_t>(p, end); break;
+    default:
+        throw std::invalid_argument("invalid eh_frame pointer encoding");
+    }
+
+    // DW_EH_PE_indirect is left to the caller: the result is then the
+    // address of the pointer rather than the pointer itself
+    switch(enc & 0x70){
+    case DW_EH_PE_absptr:
+        break;
+    case DW_EH_PE_pcrel:
+        value += vaddr;
+        break;
+    case DW_EH_PE_datarel:
+        if(datarel == EhFrameHdr::NOT_FOUND)
+            throw std::invalid_argument("unsupported eh_frame pointer encoding");
+        value += datarel;
+        break;
+    default:
+        // textrel, funcrel and aligned need runtime context
+        throw std::invalid_argument("unsupported eh_frame pointer encoding");
+    }
+
+    return is64 ? value : (uint32_t)value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+EhFrameHdr::EhFrameHdr(const ELF &elf)
+    :hdr_(nullptr), vaddr_(0), eh_frame_(NOT_FOUND), count_(0),
+     table_enc_(DW_EH_PE_omit), entry_size_(0), table_(nullptr),
+     is64_(elf.e_ident_class() == ELFCLASS64)
+{
+    uint64_t offset = 0, size = 0;
+    for(size_t i = 0; i < elf.e_phnum() && !hdr_; ++i){
+        const auto &phdr = elf.phdr(i);
+        if(phdr->p_type().value() == PT_GNU_EH_FRAME){
+            vaddr_ = phdr->p_vaddr();
+            offset = phdr->p_offset();
+            size = phdr->p_filesz();
+            hdr_ = elf.data();
+        }
+    }
+    for(size_t i = 0; i < elf.e_shnum() && !hdr_; ++i){
+        if(elf.get_sh_name(i) == ".eh_frame_hdr"){
+            vaddr_ = elf.shdr(i)->sh_addr();
+            offset = elf.shdr(i)->sh_offset();
+            size = elf.shdr(i)->sh_size();
+            hdr_ = elf.data();
+        }
+    }
+
+    if(!hdr_)
+        throw std::invalid_argument("no .eh_frame_hdr");
+    if(offset > elf.filesize() || size > elf.filesize() - offset || size < 4)
+        throw std::invalid_argument("invalid .eh_frame_hdr");
+
+    hdr_ += offset;
+    const char *end = hdr_ + size;
+    if(hdr_[0] != 1)
+        throw std::invalid_argument("unsupported .eh_frame_hdr version");
+
+    uint8_t eh_frame_ptr_enc = hdr_[1];
+    uint8_t fde_count_enc = hdr_[2];
+    table_enc_ = hdr_[3];
+
+    const char *p = hdr_ + 4;
+    eh_frame_ = decodeEhPointer(eh_frame_ptr_enc, p, end, vaddr_ + (p - hdr_), vaddr_, is64_);
+    if(fde_count_enc == DW_EH_PE_omit || table_enc_ == DW_EH_PE_omit)
+        return;
+    count_ = decodeEhPointer(fde_count_enc, p, end, vaddr_ + (p - hdr_), vaddr_, is64_);
+
+    size_t width;
+    switch(table_enc_ & 0x0f){
+    case DW_EH_PE_udata2: case DW_EH_PE_sdata2: width = 2; break;
+    case DW_EH_PE_udata4: case DW_EH_PE_sdata4: width = 4; break;
+    case DW_EH_PE_udata8: case DW_EH_PE_sdata8: width = 8; break;
+    case DW_EH_PE_absptr: width = is64_ ? 8 : 4; break;
+    default:
+        throw std::invalid_argument("unsearchable .eh_frame_hdr table");
+    }
+
+    entry_size_ = 2 * width;
+    table_ = p;
+    if(count_ > (size_t)(end - table_) / entry_size_)
+        throw std::invalid_argument("truncated .eh_frame_hdr table");
+}
+
+uint64_t EhFrameHdr::decode_at(size_t i, size_t field) const
+{
+    const size_t width = entry_size_ / 2;
+    const char *p = table_ + i * entry_size_ + field * width;
+    return decodeEhPointer(table_enc_, p, p + width, vaddr_ + (p - hdr_), vaddr_, is64_);
+}
+
+uint64_t EhFrameHdr::initial_loc(size_t i) const
+{
+    return decode_at(i, 0);
+}
+
+uint64_t EhFrameHdr::fde(size_t i) const
+{
+    return decode_at(i, 1);
+}
+
+uint64_t EhFrameHdr::lookup(uint64_t pc) const
+{
+    size_t lo = 0, hi = count_;
+    while(lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if(initial_loc(mid) <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo == 0 ? NOT_FOUND : fde(lo - 1);
+}
+
+void EhFrameHdr::lookup(const uint64_t *pcs, size_t n, uint64_t *fdes) const
+{
+    size_t pos = 0;     // entries [0, pos) start at or before the previous pc
+    for(size_t i = 0; i < n; ++i){
+        const uint64_t pc = pcs[i];
+        if(i > 0 && pc < pcs[i-1])
+            throw std::invalid_argument("pcs are not sorted");
+
+        // gallop forward until an entry starts after pc ...
+        size_t lo = pos, hi = pos, step = 1;
+        while(hi < count_ && initial_loc(hi) <= pc){
+            lo = hi + 1;
+            hi = std::min(count_, lo + step - 1);
+            step *= 2;
+        }
+
+        // ... then narrow down to the first such entry in [lo, hi]
+        while(lo < hi){
+            size_t mid = lo + (hi - lo) / 2;
+            if(initial_loc(mid) <= pc)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        pos = lo;
+        fdes[i] = pos == 0 ? NOT_FOUND : fde(pos - 1);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// records are addressed by link-time vaddr, so the index has no bias
+EhFrame::EhFrame(const ELF &elf)
+    :elf_(elf), index_(elf), hdr_(elf)
+{
+}
+
+// returns the record body (after the length); `id64` tells whether the
+// record uses the 64-bit DWARF format
+static const char *recordBody(const char *p, const char *file_end, const char *&end, bool &id64)
+{
+    uint64_t length = readRaw<uint32_t>(p, file_end);
+    id64 = (length == 0xffffffff);
+    if(id64)
+        length = readRaw<uint64_t>(p, file_end);
+
+    if(length == 0 || length > (uint64_t)(file_end - p))
+        throw std::invalid_argument("invalid eh_frame record");
+    end = p + length;
+    return p;
+}
+
+Cie EhFrame::cie(uint64_t vaddr) const
+{
+    const bool is64 = elf_.e_ident_class() == ELFCLASS64;
+
+    uint64_t offset = index_.vaddr_to_offset(vaddr);
+    if(offset == AddrIndex::NOT_MAPPED)
+        throw std::invalid_argument("eh_frame record not in file");
+
+    const char *start = elf_.data() + offset;
+    const char *end;
+    bool id64;
+    const char *p = recordBody(start, elf_.data() + elf_.filesize(), end, id64);
+
+    uint64_t id = id64 ? readRaw<uint64_t>(p, end) : readRaw<uint32_t>(p, end);
+    if(id != 0)
+        throw std::invalid_argument("not a CIE");
+
+    Cie cie;
+    cie.vaddr = vaddr;
+    cie.version = readRaw<uint8_t>(p, end);
+
+    const char *aug_end = (const char*) memchr(p, '\0', end - p);
+    if(!aug_end)
+        throw std::invalid_argument("truncated eh_frame data");
+    cie.augmentation = string(p, aug_end);
+    p = aug_end + 1;
+
+    if(cie.augmentation.find("eh") != string::npos)
+        p += is64 ? 8 : 4;
+    if(cie.version >= 4)
+        p += 2;     // address_size, segment_selector_size
+    if(p > end)
+        throw std::invalid_argument("truncated eh_frame data");
+
+    cie.code_align = readUleb(p, end);
+    cie.data_align = readSleb(p, end);
+    cie.return_reg = (cie.version == 1) ? readRaw<uint8_t>(p, end) : readUleb(p, end);
+    cie.fde_enc = DW_EH_PE_absptr;
+    cie.lsda_enc = DW_EH_PE_omit;
+    cie.personality = 0;
+    cie.signal_frame = false;
+
+    if(!cie.augmentation.empty() && cie.augmentation[0] == 'z'){
+        uint64_t len = readUleb(p, end);
+        if(len > (uint64_t)(end - p))
+            throw std::invalid_argument("truncated eh_frame data");
+        const char *data_end = p + len;
+
+        for(size_t k = 1; k < cie.augmentation.size(); ++k){
+            char c = cie.augmentation[k];
+            if(c == 'L')
+                cie.lsda_enc = readRaw<uint8_t>(p, data_end);
+            else if(c == 'R')
+                cie.fde_enc = readRaw<uint8_t>(p, data_end);
+            else if(c == 'P'){
+                uint8_t enc = readRaw<uint8_t>(p, data_end);
+                uint64_t field = vaddr + (p - start);
+                cie.personality = decodeEhPointer(enc & ~DW_EH_PE_indirect, p, data_end,
+                        field, EhFrameHdr::NOT_FOUND, is64);
+            }else if(c == 'S')
+                cie.signal_frame = true;
+            else if(c != 'B' && c != 'G')
+                break;      // unknown; the rest of the data cannot be decoded
+        }
+        p = data_end;
+    }
+
+    cie.instructions = p;
+    cie.instructions_size = end - p;
+    return cie;
+}
+
+Fde EhFrame::fde(uint64_t vaddr) const
+{
+    const bool is64 = elf_.e_ident_class() == ELFCLASS64;
+
+    uint64_t offset = index_.vaddr_to_offset(vaddr);
+    if(offset == AddrIndex::NOT_MAPPED)
+        throw std::invalid_argument("eh_frame record not in file");
+
+    const char *start = elf_.data() + offset;
+    const char *end;
+    bool id64;
+    const char *p = recordBody(start, elf_.data() + elf_.filesize(), end, id64);
+
+    // the CIE pointer is relative to its own field
+    const uint64_t id_vaddr = vaddr + (p - start);
+    uint64_t cie_ptr = id64 ? readRaw<uint64_t>(p, end) : readRaw<uint32_t>(p, end);
+    if(cie_ptr == 0)
+        throw std::invalid_argument("not an FDE");
+
+    // a handful of CIEs is shared by all the FDEs of a binary
+    const uint64_t cie_vaddr = id_vaddr - cie_ptr;
+    auto it = cies_.find(cie_vaddr);
+    if(it == cies_.end())
+        it = cies_.emplace(cie_vaddr, cie(cie_vaddr)).first;
+
+    Fde fde;
+    fde.vaddr = vaddr;
+    fde.cie = it->second;
+
+    const uint8_t enc = fde.cie.fde_enc & ~DW_EH_PE_indirect;
+    fde.pc_begin = decodeEhPointer(enc, p, end, vaddr + (p - start), EhFrameHdr::NOT_FOUND, is64);
+    fde.pc_range = decodeEhPointer(enc & 0x0f, p, end, 0, EhFrameHdr::NOT_FOUND, is64);
+    fde.lsda = 0;
+
+    const string &aug = fde.cie.augmentation;
+    if(!aug.empty() && aug[0] == 'z'){
+        uint64_t len = readUleb(p, end);
+        if(len > (uint64_t)(end - p))
+            throw std::invalid_argument("truncated eh_frame data");
+        const char *data_end = p + len;
+
+        if(fde.cie.lsda_enc != DW_EH_PE_omit && len > 0)
+            fde.lsda = decodeEhPointer(fde.cie.lsda_enc & ~DW_EH_PE_indirect, p, data_end,
+                    vaddr + (p - start), EhFrameHdr::NOT_FOUND, is64);
+        p = data_end;
+    }
+
+    fde.instructions = p;
+    fde.instructions_size = end - p;
+    return fde;
+}
+
+bool EhFrame::find(uint64_t pc, Fde &fde) const
+{
+    uint64_t vaddr = hdr_.lookup(pc);
+    if(vaddr == EhFrameHdr::NOT_FOUND)
+        return false;
+
+    fde = this->fde(vaddr);
+    return pc >= fde.pc_begin && pc - fde.pc_begin < fde.pc_range;
+}
+
+} //namespace end
@@ -0,0 +1,119 @@
+#ifndef __EH_FRAME_H
+#define __EH_FRAME_H 1
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "elf_bin.h"
+#include "addr_index.h"
+
+namespace iii{
+
+// DW_EH_PE pointer encodings used by .eh_frame and .eh_frame_hdr
+static constexpr uint8_t DW_EH_PE_absptr   = 0x00;
+static constexpr uint8_t DW_EH_PE_uleb128  = 0x01;
+static constexpr uint8_t DW_EH_PE_udata2   = 0x02;
+static constexpr uint8_t DW_EH_PE_udata4   = 0x03;
+static constexpr uint8_t DW_EH_PE_udata8   = 0x04;
+static constexpr uint8_t DW_EH_PE_sleb128  = 0x09;
+static constexpr uint8_t DW_EH_PE_sdata2   = 0x0a;
+static constexpr uint8_t DW_EH_PE_sdata4   = 0x0b;
+static constexpr uint8_t DW_EH_PE_sdata8   = 0x0c;
+static constexpr uint8_t DW_EH_PE_pcrel    = 0x10;
+static constexpr uint8_t DW_EH_PE_textrel  = 0x20;
+static constexpr uint8_t DW_EH_PE_datarel  = 0x30;
+static constexpr uint8_t DW_EH_PE_funcrel  = 0x40;
+static constexpr uint8_t DW_EH_PE_aligned  = 0x50;
+static constexpr uint8_t DW_EH_PE_indirect = 0x80;
+static constexpr uint8_t DW_EH_PE_omit     = 0xff;
+
+// The binary-search table of .eh_frame_hdr (PT_GNU_EH_FRAME), searched in
+// place. Lookups take link-time addresses and return the address of the
+// FDE with the greatest initial location <= pc, which still has to be
+// range-checked (see EhFrame::find).
+class EhFrameHdr{
+public:
+    static constexpr uint64_t NOT_FOUND = ~(uint64_t)0;
+
+    EhFrameHdr(const ELF &elf);
+
+    uint64_t vaddr() const { return vaddr_; }
+    uint64_t eh_frame() const { return eh_frame_; }
+    size_t size() const { return count_; }
+
+    uint64_t initial_loc(size_t i) const;
+    uint64_t fde(size_t i) const;
+
+    uint64_t lookup(uint64_t pc) const;
+
+    // pcs must be sorted ascending; each lookup gallops from the previous one
+    void lookup(const uint64_t *pcs, size_t n, uint64_t *fdes) const;
+
+private:
+    uint64_t decode_at(size_t i, size_t field) const;
+
+    const char *hdr_;       // start of .eh_frame_hdr in the file
+    uint64_t vaddr_;
+    uint64_t eh_frame_;
+    size_t count_;
+    uint8_t table_enc_;
+    size_t entry_size_;
+    const char *table_;
+    bool is64_;
+};
+
+struct Cie{
+    uint64_t vaddr;
+    uint8_t version;
+    string augmentation;
+    uint64_t code_align;
+    int64_t data_align;
+    uint64_t return_reg;
+    uint8_t fde_enc;
+    uint8_t lsda_enc;
+    uint64_t personality;   // address of the pointer if encoded indirect
+    bool signal_frame;
+    const char *instructions;
+    size_t instructions_size;
+};
+
+struct Fde{
+    uint64_t vaddr;
+    uint64_t pc_begin;
+    uint64_t pc_range;
+    uint64_t lsda;
+    Cie cie;
+    const char *instructions;
+    size_t instructions_size;
+};
+
+// CIE/FDE records of .eh_frame, read in place through the PT_LOAD index.
+// Decoded CIEs are cached, so an EhFrame is not safe to share between
+// threads.
+class EhFrame{
+public:
+    EhFrame(const ELF &elf);
+
+    const EhFrameHdr &hdr() const { return hdr_; }
+
+    Cie cie(uint64_t vaddr) const;
+    Fde fde(uint64_t vaddr) const;
+
+    // the FDE covering pc, via the .eh_frame_hdr table
+    bool find(uint64_t pc, Fde &fde) const;
+
+private:
+    const ELF &elf_;
+    AddrIndex index_;       // link-time addresses
+    EhFrameHdr hdr_;
+    mutable std::unordered_map<uint64_t, Cie> cies_;    // by vaddr
+};
+
+// Decode one DW_EH_PE value at p (whose address is vaddr) and advance p.
+// `datarel` is the base for DW_EH_PE_datarel, or NOT_FOUND if there is none.
+uint64_t decodeEhPointer(uint8_t enc, const char *&p, const char *end,
+        uint64_t vaddr, uint64_t datarel, bool is64);
+
+} //namespace end
+
+#endif
@@ -3,6 +3,7 @@
 #include <utility>
 #include <stdexcept>
 #include <iomanip>
+#include <cstring>
 #include "utils.h"
 #include "elf_bin.h"
 
@@ -17,6 +18,7 @@ using std::setfill;
 using std::setw;
 using iii::OstreamFlagRecover;
 using iii::readFile;
+using iii::MappedFile;
 
 ostream& operator<<(ostream &os, const Addr &addr)
 {
@@ -212,31 +214,92 @@ vector<string> splits_bin(const void *addr, size_t sz, char sp)
     return strs;
 }
 
-vector<string> ELF::dump_section_strs(size_t i) const
+const char *ELF::section_data(size_t i, uint64_t &size) const
 {
+    if(i >= shdrs_.size())
+        throw std::invalid_argument("no such section");
+
     const auto &shdr = shdrs_[i];
-    const char *sec = bin_.c_str() + shdr->sh_offset();
-    uint64_t sz = shdr->sh_size();
+    if(shdr->sh_type().value() == SHT_NOBITS){
+        size = 0;
+        return bin_;
+    }
+
+    uint64_t offset = shdr->sh_offset();
+    size = shdr->sh_size();
+    if(offset > size_ || size > size_ - offset)
+        throw std::invalid_argument("section " + std::to_string(i) + " lies outside the file");
+    return bin_ + offset;
+}
+
+string ELF::get_sh_name(size_t i) const
+{
+    if(i >= shdrs_.size())
+        throw std::invalid_argument("no such section");
+
+    uint64_t size;
+    const char *strtab = section_data(e_shstrndx(), size);
+    uint32_t name = shdrs_[i]->sh_name();
+    if(name >= size)
+        throw std::invalid_argument("section name outside .shstrtab");
+
+    // the table need not end with a NUL
+    return string(strtab + name, strnlen(strtab + name, size - name));
+}
 
-    return splits_bin(sec, sz, '\0');
+string ELF::dump_section(size_t i) const
+{
+    uint64_t size;
+    const char *sec = section_data(i, size);
+    return string(sec, size);
+}
+
+vector<string> ELF::dump_section_strs(size_t i) const
+{
+    uint64_t size;
+    const char *sec = section_data(i, size);
+    return splits_bin(sec, size, '\0');
 }
 
 ELF::ELF(const char *filename)
 {
-    bin_ = iii::readFile(filename);
+    auto file = std::make_shared<MappedFile>(filename);
+    bin_ = file->data();
+    size_ = file->size();
+    owner_ = move(file);
+    parse();
+}
+
+ELF::ELF(std::shared_ptr<const void> owner, const char *data, size_t size)
+    :owner_(move(owner)), bin_(data), size_(size)
+{
+    parse();
+}
+
+void ELF::parse()
+{
     if(filesize() < EI_NIDENT)
         throw std::invalid_argument("invalid elf header len");
 
-    ehdr_ = unique_ptr<Ehdr>(toEhdr(bin_.c_str()));
+    ehdr_ = unique_ptr<Ehdr>(toEhdr(bin_));
+
+    if(e_phnum() > 0 && (e_phentsize() < (e_ident_class() == ELFCLASS32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr)) ||
+                e_phoff() > size_ || (size_ - e_phoff()) / e_phentsize() < e_phnum()))
+        throw std::invalid_argument("invalid elf program header table");
+
+    if(e_shnum() > 0 && (e_shentsize() < (e_ident_class() == ELFCLASS32 ? sizeof(Elf32_Shdr) : sizeof(Elf64_Shdr)) ||
+                e_shoff() > size_ || (size_ - e_shoff()) / e_shentsize() < e_shnum() ||
+                e_shstrndx() >= e_shnum()))
+        throw std::invalid_argument("invalid elf section header table");
 
     for(uint16_t i = 0; i < e_phnum(); ++i){
         uint64_t offset = e_phoff() + i * e_phentsize();
-        phdrs_.emplace_back(toPhdr(bin_.c_str() + offset));
+        phdrs_.emplace_back(toPhdr(bin_ + offset));
     }
 
     for(uint16_t i = 0; i < e_shnum(); ++i){
         uint64_t offset = e_shoff() + i * e_shentsize();
-        shdrs_.emplace_back(toShdr(bin_.c_str() + offset));
+        shdrs_.emplace_back(toShdr(bin_ + offset));
     }
 }
 
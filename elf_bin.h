@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -26,8 +27,8 @@ using std::array;
 ////////////////////////////////////////////////////////////
 
 struct Addr{
-    Addr(int value = 0){ this->value = value;}
-    int value;
+    Addr(uint64_t value = 0){ this->value = value;}
+    uint64_t value;
 };
 ostream& operator<<(ostream &os, const Addr &addr);
 
@@ -327,7 +328,12 @@ class ELF{
 public:
     ELF(const char *filename);
 
-    size_t filesize() const { return bin_.length(); }
+    // view over `size` bytes at `data`, kept alive by `owner`
+    // (e.g. a member inside a mapped archive); nothing is copied.
+    ELF(std::shared_ptr<const void> owner, const char *data, size_t size);
+
+    size_t filesize() const { return size_; }
+    const char *data() const { return bin_; }
     size_t e_size()        const { return ehdr_->e_size(); }
     int e_ident_class()    const { return ehdr_->e_ident()[EI_CLASS];}
     ElfType  e_type()      const { return ehdr_->e_type();}
@@ -339,45 +345,57 @@ public:
     uint16_t e_shnum()     const { return ehdr_->e_shnum();}
     uint16_t e_shstrndx()  const { return ehdr_->e_shstrndx();}
 
-    string get_sh_name(size_t i) const {
-        uint64_t offset = shdrs_[e_shstrndx()]->sh_offset() + shdrs_[i]->sh_name();
-        return string(bin_.c_str() + offset);
-    }
-
-    string dump_section(size_t i) const {
-        const auto &shdr = shdrs_[i];
-        return string(bin_.c_str() + shdr->sh_offset(), shdr->sh_size());
-    }
-
+    // these throw std::invalid_argument if section i, or the name in
+    // .shstrtab, lies outside the file
+    string get_sh_name(size_t i) const;
+    string dump_section(size_t i) const;
     vector<string> dump_section_strs(size_t i) const;
 
     const unique_ptr<Phdr> &phdr(size_t i) const { return phdrs_[i]; }
     const unique_ptr<Shdr> &shdr(size_t i) const { return shdrs_[i]; }
 
 private:
+    // the tables are not necessarily aligned inside their buffer
+    template<typename T>
+    static T load(const void *buffer){
+        T t;
+        std::memcpy(&t, buffer, sizeof(t));
+        return t;
+    }
+
     Ehdr* toEhdr(const void *buffer){
+        if(std::memcmp(buffer, ELFMAG, SELFMAG) != 0)
+            throw std::invalid_argument("invalid elf magic");
+
         unsigned char cls =  ((const unsigned char*)buffer)[EI_CLASS];
-        if(cls == ELFCLASS32)
-            return new Ehdr32(*(Elf32_Ehdr*)buffer);
-        else if(cls == ELFCLASS64)
-            return new Ehdr64(*(Elf64_Ehdr*)buffer);
+        if(cls == ELFCLASS32 && size_ >= sizeof(Elf32_Ehdr))
+            return new Ehdr32(load<Elf32_Ehdr>(buffer));
+        else if(cls == ELFCLASS64 && size_ >= sizeof(Elf64_Ehdr))
+            return new Ehdr64(load<Elf64_Ehdr>(buffer));
         else
             throw std::invalid_argument("invalid elf class");
     }
 
     Phdr* toPhdr(const void *buffer){
         return (e_ident_class() == ELFCLASS32)?
-                    (Phdr*) new Phdr32(*(Elf32_Phdr*)buffer):
-                    (Phdr*) new Phdr64(*(Elf64_Phdr*)buffer);
+                    (Phdr*) new Phdr32(load<Elf32_Phdr>(buffer)):
+                    (Phdr*) new Phdr64(load<Elf64_Phdr>(buffer));
     }
 
     Shdr* toShdr(const void *buffer){
         return (e_ident_class() == ELFCLASS32)?
-                    (Shdr*) new Shdr32(*(Elf32_Shdr*)buffer):
-                    (Shdr*) new Shdr64(*(Elf64_Shdr*)buffer);
+                    (Shdr*) new Shdr32(load<Elf32_Shdr>(buffer)):
+                    (Shdr*) new Shdr64(load<Elf64_Shdr>(buffer));
     }
 
-    string bin_;
+    void parse();
+
+    // file bytes of section i; SHT_NOBITS sections have none
+    const char *section_data(size_t i, uint64_t &size) const;
+
+    std::shared_ptr<const void> owner_;
+    const char *bin_;
+    size_t size_;
     unique_ptr<Ehdr> ehdr_;
     vector<unique_ptr<Phdr>> phdrs_;
     vector<unique_ptr<Shdr>> shdrs_;
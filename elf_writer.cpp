@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include "utils.h"
+#include "elf_writer.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+
+static bool matchName(const string &name, const vector<string> &patterns)
+{
+    for(const auto &pat: patterns){
+        if(!pat.empty() && pat.back() == '*'){
+            if(name.compare(0, pat.size() - 1, pat, 0, pat.size() - 1) == 0)
+                return true;
+        }else if(name == pat)
+            return true;
+    }
+    return false;
+}
+
+vector<bool> selectSections(const ELF &elf, const vector<string> &only,
+        const vector<string> &remove)
+{
+    vector<bool> keep(elf.e_shnum());
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        const string &name = elf.get_sh_name(i);
+        keep[i] = (only.empty() || matchName(name, only)) && !matchName(name, remove);
+    }
+    return keep;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+namespace{
+
+void writeAll(int fd, const void *buf, size_t len, uint64_t offset)
+{
+    const char *p = (const char*) buf;
+    while(len > 0){
+        ssize_t n = pwrite(fd, p, len, offset);
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "pwrite");
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+// file-to-file copy inside the kernel
+void copyRange(int in, uint64_t in_off, int out, uint64_t out_off, uint64_t len)
+{
+    bool use_cfr = true;
+    while(len > 0){
+        const size_t chunk = std::min<uint64_t>(len, 1u << 30);
+        ssize_t n;
+        if(use_cfr){
+            loff_t i = in_off, o = out_off;
+            n = copy_file_range(in, &i, out, &o, chunk, 0);
+            if(n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                        errno == EOPNOTSUPP)){
+                use_cfr = false;
+                continue;
+            }
+        }else{
+            // sendfile writes at the current file position of `out`
+            if(lseek(out, out_off, SEEK_SET) < 0)
+                throw std::system_error(errno, std::generic_category(), "lseek");
+            off_t i = in_off;
+            n = sendfile(out, in, &i, chunk);
+        }
+
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "copy section");
+        }
+        if(n == 0)
+            throw std::runtime_error("unexpected end of input file");
+
+        in_off += n;
+        out_off += n;
+        len -= n;
+    }
+}
+
+template<typename T>
+T loadAt(const char *p)
+{
+    T t;
+    memcpy(&t, p, sizeof(t));
+    return t;
+}
+
+// SHT_GROUP payload of section i without the members that are dropped
+string groupPayload(const ELF &elf, size_t i, const vector<bool> &keep)
+{
+    const auto &shdr = elf.shdr(i);
+    const char *data = elf.data() + shdr->sh_offset();
+    const size_t count = shdr->sh_size() / sizeof(Elf32_Word);
+
+    string buf;
+    for(size_t n = 0; n < count; ++n){
+        Elf32_Word idx = loadAt<Elf32_Word>(data + n * sizeof(Elf32_Word));
+        if(n == 0 || (idx < keep.size() && keep[idx]))
+            buf.append((const char*)&idx, sizeof(idx));
+    }
+    return buf;
+}
+
+// the SHT_SYMTAB_SHNDX table of symbol table i (with `count` symbols), if
+// it has one in the file
+const char *extendedIndices(const ELF &elf, size_t i, size_t count)
+{
+    for(size_t j = 0; j < elf.e_shnum(); ++j){
+        const auto &shdr = elf.shdr(j);
+        if(shdr->sh_type().value() == SHT_SYMTAB_SHNDX && shdr->sh_link() == i &&
+                shdr->sh_offset() <= elf.filesize() &&
+                shdr->sh_size() <= elf.filesize() - shdr->sh_offset() &&
+                shdr->sh_size() / sizeof(Elf32_Word) >= count)
+            return elf.data() + shdr->sh_offset();
+    }
+    return nullptr;
+}
+
+// Renumbering can only drop sections that no kept section links to.
+void checkLinks(const ELF &elf, const vector<bool> &keep)
+{
+    for(size_t i = 1; i < keep.size(); ++i){
+        if(!keep[i])
+            continue;
+
+        const auto &shdr = elf.shdr(i);
+        uint32_t type = shdr->sh_type().value();
+        vector<uint32_t> links{shdr->sh_link()};
+        if(type == SHT_REL || type == SHT_RELA || (shdr->sh_flags() & SHF_INFO_LINK))
+            links.push_back(shdr->sh_info());
+
+        for(uint32_t link: links){
+            if(link != 0 && link < keep.size() && !keep[link])
+                throw std::invalid_argument(elf.get_sh_name(i) + " links to dropped section " +
+                        elf.get_sh_name(link) + "; keep it as well, or keep indices (-k)");
+        }
+    }
+}
+
+// whether every section that is part of the loaded image is kept
+bool allocKept(const ELF &elf, const vector<bool> &keep)
+{
+    for(size_t i = 1; i < keep.size(); ++i){
+        if(!keep[i] && (elf.shdr(i)->sh_flags() & SHF_ALLOC))
+            return false;
+    }
+    return true;
+}
+
+// end of the part of the file the loader and the allocated sections use:
+// the ELF header, the program headers, every segment and SHF_ALLOC section
+uint64_t loadedPrefix(const ELF &elf)
+{
+    uint64_t end = elf.e_size();
+    auto extend = [&](uint64_t offset, uint64_t size){
+        if(offset > elf.filesize() || size > elf.filesize() - offset)
+            throw std::invalid_argument("segment outside of file");
+        end = std::max(end, offset + size);
+    };
+
+    extend(elf.e_phoff(), (uint64_t)elf.e_phnum() * elf.e_phentsize());
+    for(size_t i = 0; i < elf.e_phnum(); ++i)
+        extend(elf.phdr(i)->p_offset(), elf.phdr(i)->p_filesz());
+    for(size_t i = 1; i < elf.e_shnum(); ++i){
+        const auto &shdr = elf.shdr(i);
+        if((shdr->sh_flags() & SHF_ALLOC) && shdr->sh_type().value() != SHT_NOBITS)
+            extend(shdr->sh_offset(), shdr->sh_size());
+    }
+    return end;
+}
+
+// Writes into a temporary file next to `dst`, renamed over it by commit();
+// until then `dst` is untouched, and the temporary goes away on failure.
+class TempFile{
+public:
+    explicit TempFile(const char *dst)
+        :dst_(dst), path_(string(dst) + ".XXXXXX"), fd_(mkostemp(&path_[0], O_CLOEXEC))
+    {
+        if(fd_.get() < 0)
+            throw std::system_error(errno, std::generic_category(), "create");
+    }
+
+    ~TempFile(){
+        if(!path_.empty())
+            unlink(path_.c_str());
+    }
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    int get() const { return fd_.get(); }
+
+    void commit(){
+        if(rename(path_.c_str(), dst_) < 0)
+            throw std::system_error(errno, std::generic_category(), "rename");
+        path_.clear();
+    }
+
+private:
+    const char *dst_;
+    string path_;
+    FileDesc fd_;
+};
+
+template<typename Ehdr_t, typename Shdr_t, typename Sym_t>
+bool writeImpl(const ELF &elf, int in, int out, const vector<bool> &keep, bool keep_indices)
+{
+    const size_t shnum = elf.e_shnum();
+    const size_t shstrndx = elf.e_shstrndx() < shnum ? elf.e_shstrndx() : 0;
+
+    // output headers (as old indices), and old index -> new index
+    vector<size_t> order;
+    vector<size_t> renumber(shnum, 0);
+    for(size_t i = 0; i < shnum; ++i){
+        if(!keep[i] && !keep_indices)
+            continue;
+        renumber[i] = order.size();
+        order.push_back(i);
+    }
+    const bool renumbered = order.size() != shnum;
+
+    // With every allocated section kept, the output stays loadable: the
+    // program headers and the allocated sections keep their offsets and
+    // are copied as one prefix. Everything else is laid out back to back
+    // after that prefix, or after the ELF header.
+    const bool loadable = elf.e_phnum() > 0 && allocKept(elf, keep);
+    const uint64_t prefix = loadable ? loadedPrefix(elf) : 0;
+
+    vector<Shdr_t> shdrs(order.size());
+    uint64_t offset = loadable ? prefix : sizeof(Ehdr_t);
+    for(size_t k = 0; k < order.size(); ++k){
+        const size_t i = order[k];
+        Shdr_t sh = loadAt<Shdr_t>(elf.data() + elf.e_shoff() + i * elf.e_shentsize());
+        if(i == 0){
+            shdrs[k] = sh;
+            continue;
+        }
+
+        const bool in_prefix = loadable && (sh.sh_flags & SHF_ALLOC);
+        if(!keep[i])
+            sh.sh_type = SHT_NOBITS;
+        if(renumbered && sh.sh_type == SHT_GROUP)
+            sh.sh_size = groupPayload(elf, i, keep).size();
+
+        if(!in_prefix){
+            if(sh.sh_type != SHT_NOBITS){
+                uint64_t align = sh.sh_addralign > 1 ? sh.sh_addralign : 1;
+                offset = (offset + align - 1) / align * align;
+            }
+            sh.sh_offset = offset;
+            if(sh.sh_type != SHT_NOBITS)
+                offset += sh.sh_size;
+        }
+
+        if(renumbered){
+            if(sh.sh_link < shnum)
+                sh.sh_link = renumber[sh.sh_link];
+            if((sh.sh_type == SHT_REL || sh.sh_type == SHT_RELA || (sh.sh_flags & SHF_INFO_LINK)) &&
+                    sh.sh_info < shnum)
+                sh.sh_info = renumber[sh.sh_info];
+        }
+        shdrs[k] = sh;
+    }
+
+    const uint64_t align = sizeof(shdrs[0].sh_addr);
+    const uint64_t shoff = (offset + align - 1) / align * align;
+
+    if(loadable)
+        copyRange(in, 0, out, 0, prefix);
+
+    // payloads: copied in the kernel unless section indices inside them change
+    for(size_t k = 1; k < order.size(); ++k){
+        const size_t i = order[k];
+        const Shdr_t &sh = shdrs[k];
+        if(sh.sh_type == SHT_NOBITS)
+            continue;
+        const bool in_prefix = loadable && (sh.sh_flags & SHF_ALLOC);
+
+        const uint64_t src = elf.shdr(i)->sh_offset();
+        if(src > elf.filesize() || sh.sh_size > elf.filesize() - src)
+            throw std::invalid_argument("section outside of file");
+
+        const bool has_indices = sh.sh_type == SHT_SYMTAB || sh.sh_type == SHT_DYNSYM ||
+                                 sh.sh_type == SHT_GROUP || sh.sh_type == SHT_SYMTAB_SHNDX;
+        if(!renumbered || !has_indices){
+            if(!in_prefix)
+                copyRange(in, src, out, sh.sh_offset, sh.sh_size);
+            continue;
+        }
+
+        string buf;
+        if(sh.sh_type == SHT_GROUP){
+            buf = groupPayload(elf, i, keep);
+            for(size_t n = 1; n * sizeof(Elf32_Word) < buf.size(); ++n){
+                Elf32_Word idx = loadAt<Elf32_Word>(&buf[n * sizeof(Elf32_Word)]);
+                idx = renumber[idx];
+                memcpy(&buf[n * sizeof(Elf32_Word)], &idx, sizeof(idx));
+            }
+        }else if(sh.sh_type == SHT_SYMTAB || sh.sh_type == SHT_DYNSYM){
+            buf.assign(elf.data() + src, sh.sh_size);
+            const size_t entsize = sh.sh_entsize >= sizeof(Sym_t) ? sh.sh_entsize : sizeof(Sym_t);
+            const char *xindex = extendedIndices(elf, i, buf.size() / entsize);
+            for(size_t off = 0, n = 0; off + sizeof(Sym_t) <= buf.size(); off += entsize, ++n){
+                Sym_t sym = loadAt<Sym_t>(&buf[off]);
+                const bool extended = sym.st_shndx == SHN_XINDEX && xindex;
+                if(!extended && (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= SHN_LORESERVE))
+                    continue;
+
+                size_t shndx = extended ? loadAt<Elf32_Word>(xindex + n * sizeof(Elf32_Word))
+                                        : sym.st_shndx;
+                // symbols of dropped sections keep their value for symbolization
+                if(shndx >= shnum)
+                    sym.st_shndx = extended ? sym.st_shndx : SHN_UNDEF;
+                else if(!keep[shndx])
+                    sym.st_shndx = SHN_ABS;
+                else if(!extended)
+                    sym.st_shndx = renumber[shndx];
+                memcpy(&buf[off], &sym, sizeof(sym));
+            }
+        }else{
+            // one section index per symbol; see the symbol table for dropped ones
+            buf.assign(elf.data() + src, sh.sh_size);
+            for(size_t n = 0; (n + 1) * sizeof(Elf32_Word) <= buf.size(); ++n){
+                Elf32_Word idx = loadAt<Elf32_Word>(&buf[n * sizeof(Elf32_Word)]);
+                idx = (idx < shnum && keep[idx]) ? renumber[idx] : 0;
+                memcpy(&buf[n * sizeof(Elf32_Word)], &idx, sizeof(idx));
+            }
+        }
+        writeAll(out, buf.data(), buf.size(), sh.sh_offset);
+    }
+
+    Ehdr_t eh = loadAt<Ehdr_t>(elf.data());
+    if(!loadable){
+        eh.e_phoff = 0;
+        eh.e_phnum = 0;
+    }
+    eh.e_shoff = order.empty() ? 0 : shoff;
+    eh.e_shentsize = sizeof(Shdr_t);
+    eh.e_shnum = order.size();
+    eh.e_shstrndx = renumber.empty() ? SHN_UNDEF : renumber[shstrndx];
+
+    writeAll(out, &eh, sizeof(eh), 0);
+    writeAll(out, shdrs.data(), shdrs.size() * sizeof(Shdr_t), shoff);
+    if(ftruncate(out, shoff + shdrs.size() * sizeof(Shdr_t)) < 0)
+        throw std::system_error(errno, std::generic_category(), "ftruncate");
+    return loadable;
+}
+
+} //namespace
+
+bool writeSections(const ELF &elf, const char *src, const char *dst,
+        const vector<bool> &keep, bool keep_indices)
+{
+    const size_t shnum = elf.e_shnum();
+    vector<bool> kept(keep);
+    kept.resize(shnum, false);
+    if(shnum > 0){
+        kept[0] = true;
+        kept[elf.e_shstrndx() < shnum ? elf.e_shstrndx() : 0] = true;
+    }
+    if(!keep_indices)
+        checkLinks(elf, kept);
+
+    FileDesc in(open(src, O_RDONLY | O_CLOEXEC));
+    if(in.get() < 0)
+        throw std::system_error(errno, std::generic_category(), src);
+
+    struct stat in_st;
+    if(fstat(in.get(), &in_st) < 0)
+        throw std::system_error(errno, std::generic_category(), src);
+
+    // the input stays intact (and mapped) until the rename, so dst may be src
+    TempFile out(dst);
+    if(fchmod(out.get(), in_st.st_mode & 0777) < 0)
+        throw std::system_error(errno, std::generic_category(), "fchmod");
+
+    bool loadable;
+    if(elf.e_ident_class() == ELFCLASS32)
+        loadable = writeImpl<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(elf, in.get(), out.get(), kept, keep_indices);
+    else
+        loadable = writeImpl<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(elf, in.get(), out.get(), kept, keep_indices);
+    out.commit();
+    return loadable;
+}
+
+} //namespace end
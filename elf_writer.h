@@ -0,0 +1,43 @@
+#ifndef __ELF_WRITER_H
+#define __ELF_WRITER_H 1
+
+#include <string>
+#include <vector>
+#include "elf_bin.h"
+
+namespace iii{
+
+// Sections whose names match `only` (all, if empty) and not `remove`.
+// A pattern ending in '*' matches by prefix, e.g. ".debug_*".
+vector<bool> selectSections(const ELF &elf, const vector<string> &only,
+        const vector<string> &remove);
+
+// Write the sections selected by `keep` from `elf` (read from the file
+// `src`) into a new ELF file `dst`, objcopy --only-section style.
+//
+// Section 0 and the section name table are always kept. By default the
+// kept sections are renumbered: sh_link/sh_info, symbol st_shndx and
+// group members are rewritten to match. Symbols defined in a dropped
+// section become SHN_ABS (their value is unchanged), dropped members
+// leave their groups, and a kept section whose sh_link/sh_info names a
+// dropped one is an error (std::invalid_argument), checked before `dst`
+// is touched. With `keep_indices`, dropped sections stay in the header
+// table as empty SHT_NOBITS entries instead (like objcopy
+// --only-keep-debug), so nothing needs rewriting.
+//
+// If every SHF_ALLOC section is kept, the program headers are carried
+// over and the loaded part of the file keeps its layout, so a stripped
+// executable still runs; the other sections are packed after it. Once an
+// allocated section is dropped the output cannot be loaded: it gets no
+// program headers and writeSections returns false.
+//
+// Unchanged payloads are copied file-to-file with copy_file_range
+// (falling back to sendfile) and never pass through user space. The
+// output is written to a temporary file, renamed over `dst` once
+// complete, with the permission bits of `src`.
+bool writeSections(const ELF &elf, const char *src, const char *dst,
+        const vector<bool> &keep, bool keep_indices = false);
+
+} //namespace end
+
+#endif
@@ -1,134 +1,506 @@
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <map>
+#include <functional>
+#include <numeric>
+#include <algorithm>
+#include <cstring>
 #include "elf_bin.h"
+#include "addr_index.h"
+#include "archive.h"
+#include "symsearch.h"
+#include "utils.h"
+#include "summary.h"
+#include "watcher.h"
+#include "scanner.h"
+#include "eh_frame.h"
+#include "elf_writer.h"
+#include "sym_stream.h"
+#include "flag_inventory.h"
 
 using std::cout;
 using std::cerr;
 using std::endl;
 using std::string;
 using std::map;
+using std::ostream;
 using std::ostringstream;
 using namespace iii;
 
 
 void printUsage()
 {
-    cerr << "usage: elfparser <elf-file>" << endl;
+    cerr << "usage: elfparser <elf-file|archive>" << endl;
+    cerr << "       elfparser -x <elf-file> [-l <load-base>] <vaddr>..." << endl;
+    cerr << "       elfparser -s [-E] <pattern> <file|dir>..." << endl;
+    cerr << "       elfparser -w [-d <debounce-ms>] <dir>..." << endl;
+    cerr << "       elfparser -b [-q <queue-depth>] <file|dir>..." << endl;
+    cerr << "       elfparser -u <elf-file> [-l <load-base>] <pc>..." << endl;
+    cerr << "       elfparser -o <out-file> [-k] [-j <section>]... [-R <section>]... <elf-file>" << endl;
+    cerr << "       elfparser -S <elf-file> [<section>]" << endl;
+    cerr << "       elfparser -g <file|dir>..." << endl;
 }
 
-string str(ostringstream &sout)
+// Run a batch lookup that needs ascending input on keys in any order:
+// `lookup` sees the keys sorted, the results come back in input order.
+vector<uint64_t> lookupUnsorted(const vector<uint64_t> &keys,
+        const std::function<void(const uint64_t*, size_t, uint64_t*)> &lookup)
 {
-    string s = sout.str();
-    sout.str("");
-    sout.clear();
-    return s;
+    vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+            [&keys](size_t a, size_t b){ return keys[a] < keys[b]; });
+
+    vector<uint64_t> sorted(keys.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        sorted[i] = keys[order[i]];
+
+    vector<uint64_t> found(sorted.size());
+    lookup(sorted.data(), sorted.size(), found.data());
+
+    vector<uint64_t> result(keys.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        result[order[i]] = found[i];
+    return result;
+}
+
+// translate the addresses in one sorted batch, print them in input order
+int translateAddrs(int argc, char* argv[])
+{
+    if(argc < 4){
+        printUsage();
+        return 1;
+    }
+
+    const char* filename = argv[2];
+    int argi = 3;
+    uint64_t load_base = 0;
+    bool has_base = false;
+    if(strcmp(argv[argi], "-l") == 0 && argi + 1 < argc){
+        load_base = strtoull(argv[argi + 1], nullptr, 0);
+        has_base = true;
+        argi += 2;
+    }
+
+    vector<uint64_t> vaddrs;
+    for(; argi < argc; ++argi)
+        vaddrs.push_back(strtoull(argv[argi], nullptr, 0));
+
+    ELF elf(filename);
+    AddrIndex index = has_base ? AddrIndex(elf, load_base) : AddrIndex(elf);
+    vector<uint64_t> result = lookupUnsorted(vaddrs,
+            [&index](const uint64_t *sorted, size_t n, uint64_t *offsets){
+                index.vaddrs_to_offsets(sorted, n, offsets);
+            });
+
+    for(size_t i = 0; i < vaddrs.size(); ++i){
+        cout << Addr(vaddrs[i]) << " -> ";
+        if(result[i] == AddrIndex::NOT_MAPPED)
+            cout << "N/A" << endl;
+        else
+            cout << Addr(result[i]) << endl;
+    }
+    return 0;
+}
+
+void printElf(ostream &os, const ELF &elf)
+{
+    os << "ELF Type: " << elf.e_type() << endl;
+
+    map<uint64_t, string> layout = makeLayout(elf);
+    for(auto it = layout.cbegin(); it != layout.cend(); ++it)
+        os << Addr(it->first) << " " << it->second << endl;
+
+    vector<string> args = findGccCmdArgs(elf);
+    if(args.empty())
+        os << "Gcc Args: N/A" << endl;
+    else{
+        os << "Gcc Args:" << endl;
+        for(auto it = args.cbegin(); it != args.cend(); ++it)
+            os << "  " << *it << endl;
+    }
+}
+
+bool isArchiveFile(const char *filename)
+{
+    char magic[8];
+    std::ifstream infile(filename, std::ios::binary);
+    infile.read(magic, sizeof(magic));
+    return infile && Archive::is_archive(magic, sizeof(magic));
 }
 
-map<uint64_t,string> makeLayout(const ELF &elf)
+// members are parsed in parallel, then reported in archive order
+void printArchive(ostream &os, const Archive &ar, unsigned threads = 0)
 {
-    ostringstream sout;
-    map<uint64_t,string> addrmap;
-
-    // Elf header ====
-    uint64_t offset = 0;
-    addrmap[offset] = "----EHdr-----"; 
-
-    offset = elf.e_size();
-    addrmap[offset] = "-------------";
-
-    // Program Header
-    if(elf.e_phnum() > 0){
-        offset = elf.e_phoff();
-        addrmap[offset] = "----Phdr-----"; 
-
-        for(size_t i = 0; i < elf.e_phnum(); ++i){
-            const auto &phdr = elf.phdr(i);
-            sout << "Phdr[" << i << "] " << phdr->p_type()
-                 << " " << Addr(phdr->p_offset())
-                 << "~" << Addr(phdr->p_offset() + phdr->p_filesz());
-            addrmap[offset] = str(sout);
-            offset += elf.e_phentsize();
+    os << "Archive: " << ar.size() << " members, "
+       << ar.symbols().size() << " symbols" << endl;
+
+    vector<string> reports(ar.size());
+    ar.for_each_member([&reports](size_t i, const ELF &elf){
+        ostringstream sout;
+        printElf(sout, elf);
+        reports[i] = sout.str();
+    }, threads);
+
+    for(size_t i = 0; i < ar.size(); ++i){
+        os << endl << "Member[" << i << "] " << ar.member(i).name << endl;
+        if(reports[i].empty())
+            os << "not an ELF object" << endl;
+        else
+            os << reports[i];
+    }
+}
+
+void printHits(ostream &os, const string &label, const ELF &elf, const vector<SymbolHit> &hits)
+{
+    for(const auto &hit: hits){
+        os << label << ": " << (hit.defined ? "def " : "ref ")
+           << elf.get_sh_name(hit.section) << "[" << hit.index << "] "
+           << hit.name << endl;
+    }
+}
+
+// files are searched in parallel; results are printed in input order
+int searchSymbols(int argc, char* argv[])
+{
+    int argi = 2;
+    bool is_regex = false;
+    if(argi < argc && strcmp(argv[argi], "-E") == 0){
+        is_regex = true;
+        ++argi;
+    }
+    if(argc - argi < 2){
+        printUsage();
+        return 1;
+    }
+
+    SymbolMatcher matcher(argv[argi++], is_regex);
+    vector<string> files = listFiles(vector<string>(argv + argi, argv + argc));
+    vector<string> reports(files.size());
+    vector<string> errors(files.size());
+
+    parallelFor(files.size(), [&](size_t i){
+        ostringstream sout;
+        try{
+            auto file = std::make_shared<MappedFile>(files[i].c_str());
+            if(Archive::is_archive(file->data(), file->size())){
+                Archive ar(file, file->data(), file->size());
+                ar.for_each_member([&](size_t m, const ELF &elf){
+                    printHits(sout, files[i] + "(" + ar.member(m).name + ")",
+                            elf, matcher.search(elf));
+                }, 1);
+            }else{
+                ELF elf(file, file->data(), file->size());
+                printHits(sout, files[i], elf, matcher.search(elf));
+            }
+        }catch(std::invalid_argument&){
+            // not an ELF file or archive
+        }catch(std::exception &e){
+            errors[i] = e.what();
         }
+        reports[i] = sout.str();
+    });
 
-        addrmap[offset] = "-------------";
+    for(size_t i = 0; i < files.size(); ++i){
+        if(!errors[i].empty())
+            cerr << files[i] << ": " << errors[i] << endl;
+        cout << reports[i];
+    }
+    return 0;
+}
+
+// keep an index of the trees current; "dump"/"quit" are read from stdin
+int watchDirs(int argc, char* argv[])
+{
+    int argi = 2;
+    int debounce_ms = 200;
+    if(argi + 1 < argc && strcmp(argv[argi], "-d") == 0){
+        debounce_ms = atoi(argv[argi + 1]);
+        argi += 2;
+    }
+    if(argi >= argc){
+        printUsage();
+        return 1;
     }
 
-    // Sections ======================================
-    if(elf.e_shnum() > 0){
-        offset = elf.shdr(0)->sh_offset();
-        addrmap[offset] = "---- Sections -----"; 
+    FileIndex index;
+    Watcher watcher(index, debounce_ms);
+    for(; argi < argc; ++argi)
+        watcher.add_tree(argv[argi]);
 
-        for(size_t i = 0; i < elf.e_shnum(); ++i){
-            const auto &shdr = elf.shdr(i);
+    cerr << "watch: " << index.size() << " indexed" << endl;
+    watcher.run(cout);
+    return 0;
+}
+
+// read everything through the scan engine, report in input order
+int scanBatch(int argc, char* argv[])
+{
+    int argi = 2;
+    ScanOptions opts;
+    if(argi + 1 < argc && strcmp(argv[argi], "-q") == 0){
+        opts.queue_depth = atoi(argv[argi + 1]);
+        argi += 2;
+    }
+    if(argi >= argc){
+        printUsage();
+        return 1;
+    }
 
-            offset = shdr->sh_offset();
-            sout << "Section[" << i << "] " << shdr->sh_type();
-            addrmap[offset] = str(sout);
+    vector<string> files = listFiles(vector<string>(argv + argi, argv + argc));
+    vector<string> reports(files.size());
+    vector<string> errors(files.size());
 
-            offset += shdr->sh_size();
-            addrmap[offset] ="-------------";
+    scanFiles(files, [&](size_t i, std::shared_ptr<const MappedFile> file, int error){
+        if(error){
+            errors[i] = std::generic_category().message(error);
+            return;
         }
+
+        ostringstream sout;
+        try{
+            if(Archive::is_archive(file->data(), file->size()))
+                printArchive(sout, Archive(file, file->data(), file->size()), 1);
+            else
+                printElf(sout, ELF(file, file->data(), file->size()));
+        }catch(std::exception &e){
+            errors[i] = e.what();
+        }
+        reports[i] = sout.str();
+    }, opts);
+
+    int ret = 0;
+    for(size_t i = 0; i < files.size(); ++i){
+        if(!errors[i].empty()){
+            cerr << files[i] << ": " << errors[i] << endl;
+            ret = 1;
+        }
+        if(!reports[i].empty())
+            cout << "== " << files[i] << endl << reports[i];
+    }
+    return ret;
+}
+
+// find the FDE of every pc with one batched .eh_frame_hdr lookup
+int findFdes(int argc, char* argv[])
+{
+    if(argc < 4){
+        printUsage();
+        return 1;
     }
 
-    // Section Header ===================
-    if(elf.e_shnum() > 0){
-        offset = elf.e_shoff();
-        addrmap[offset] ="----Shdr-----"; 
+    const char* filename = argv[2];
+    int argi = 3;
+    uint64_t load_base = 0;
+    bool has_base = false;
+    if(strcmp(argv[argi], "-l") == 0 && argi + 1 < argc){
+        load_base = strtoull(argv[argi + 1], nullptr, 0);
+        has_base = true;
+        argi += 2;
+    }
 
-        for(size_t i = 0; i < elf.e_shnum(); ++i){
-            const auto &shdr = elf.shdr(i);
-            const string &shname = elf.get_sh_name(i);
-            const auto &shtype = shdr->sh_type();
+    ELF elf(filename);
+    EhFrame eh_frame(elf);
+    const uint64_t bias = has_base ? loadBias(elf, load_base) : 0;
 
-            sout << "Shdr[" << i << "] " << shtype << " " << shname;
-            addrmap[offset] = str(sout);
+    vector<uint64_t> pcs;
+    for(; argi < argc; ++argi)
+        pcs.push_back(strtoull(argv[argi], nullptr, 0));
 
-            offset += elf.e_shentsize();
-            addrmap[offset] = "-------------";
+    // .eh_frame_hdr holds link-time addresses
+    vector<uint64_t> links(pcs.size());
+    for(size_t i = 0; i < pcs.size(); ++i)
+        links[i] = pcs[i] - bias;
+
+    vector<uint64_t> fdes = lookupUnsorted(links,
+            [&eh_frame](const uint64_t *sorted, size_t n, uint64_t *found){
+                eh_frame.hdr().lookup(sorted, n, found);
+            });
+
+    int ret = 0;
+    for(size_t i = 0; i < pcs.size(); ++i){
+        cout << Addr(pcs[i]) << " -> ";
+
+        if(fdes[i] == EhFrameHdr::NOT_FOUND){
+            cout << "N/A" << endl;
+            continue;
         }
+
+        Fde fde;
+        try{
+            fde = eh_frame.fde(fdes[i]);
+        }catch(std::exception &e){
+            cout << "error: " << e.what() << endl;
+            ret = 1;
+            continue;
+        }
+        if(links[i] - fde.pc_begin >= fde.pc_range){
+            cout << "N/A" << endl;
+            continue;
+        }
+
+        cout << "FDE " << Addr(fde.vaddr)
+             << " " << Addr(fde.pc_begin) << "~" << Addr(fde.pc_begin + fde.pc_range)
+             << " CIE " << Addr(fde.cie.vaddr) << " \"" << fde.cie.augmentation << "\""
+             << " insns " << fde.instructions_size << endl;
+    }
+    return ret;
+}
+
+// copy the selected sections of an ELF file into a new one
+int extractSections(int argc, char* argv[])
+{
+    if(argc < 4){
+        printUsage();
+        return 1;
     }
 
-    addrmap[elf.filesize()] =  "----EOF----";
-    return addrmap;
+    const char* outname = argv[2];
+    bool keep_indices = false;
+    vector<string> only, remove;
+    int argi = 3;
+    for(; argi < argc - 1; ++argi){
+        if(strcmp(argv[argi], "-k") == 0)
+            keep_indices = true;
+        else if(strcmp(argv[argi], "-j") == 0 && argi + 2 < argc)
+            only.push_back(argv[++argi]);
+        else if(strcmp(argv[argi], "-R") == 0 && argi + 2 < argc)
+            remove.push_back(argv[++argi]);
+        else{
+            printUsage();
+            return 1;
+        }
+    }
+
+    const char* filename = argv[argi];
+    try{
+        ELF elf(filename);
+        bool loadable = writeSections(elf, filename, outname,
+                selectSections(elf, only, remove), keep_indices);
+        if(!loadable && elf.e_phnum() > 0)
+            cerr << outname << ": warning: allocated sections dropped, "
+                 << "program headers not kept" << endl;
+    }catch(std::exception &e){
+        cerr << outname << ": " << e.what() << endl;
+        return 1;
+    }
+    return 0;
 }
 
-vector<string> findGccCmdArgs(const ELF &elf)
+// symbol tables (or one section's strings) through fixed-size windows
+int streamSymbols(int argc, char* argv[])
 {
+    if(argc != 3 && argc != 4){
+        printUsage();
+        return 1;
+    }
+
+    const char* filename = argv[2];
+    ELF elf(filename);
+
+    if(argc == 4){
+        for(size_t i = 0; i < elf.e_shnum(); ++i){
+            if(elf.get_sh_name(i) != argv[3])
+                continue;
+            forEachSectionStr(filename, elf, i, [](const string &s){ cout << s << endl; });
+            return 0;
+        }
+        cerr << "no section " << argv[3] << endl;
+        return 1;
+    }
+
     for(size_t i = 0; i < elf.e_shnum(); ++i){
-        const string &shname = elf.get_sh_name(i);
-        if(shname.compare(".GCC.command.line") == 0)
-            return elf.dump_section_strs(i);
+        uint32_t type = elf.shdr(i)->sh_type().value();
+        if(type != SHT_SYMTAB && type != SHT_DYNSYM)
+            continue;
+
+        SymbolStream syms(filename, elf, i);
+        cout << "== " << elf.get_sh_name(i) << " (" << syms.size() << ")" << endl;
+        SymbolEntry sym;
+        while(syms.next(sym))
+            cout << sym.index << " " << Addr(sym.value) << " " << sym.size << " " << sym.name << endl;
     }
+    return 0;
+}
+
+// .GCC.command.line and .comment of many files, as one deduplicated report
+int inventoryFlags(int argc, char* argv[])
+{
+    int argi = 2;
+    if(argi >= argc){
+        printUsage();
+        return 1;
+    }
+
+    vector<string> files = listFiles(vector<string>(argv + argi, argv + argc));
+    vector<string> errors(files.size());
+    FlagInventory inventory(files.size());
 
-    return vector<string>{};
+    // mapped, so only the headers and the two sections are read
+    parallelFor(files.size(), [&](size_t i){
+        try{
+            auto file = std::make_shared<MappedFile>(files[i].c_str());
+            if(Archive::is_archive(file->data(), file->size())){
+                Archive ar(file, file->data(), file->size());
+                ar.for_each_member([&](size_t m, const ELF &elf){
+                    inventory.add(i, files[i] + "(" + ar.member(m).name + ")",
+                            findGccCmdArgs(elf), findComments(elf));
+                }, 1);
+            }else{
+                ELF elf(file, file->data(), file->size());
+                inventory.add(i, files[i], findGccCmdArgs(elf), findComments(elf));
+            }
+        }catch(std::invalid_argument&){
+            // not an ELF file or archive
+        }catch(std::exception &e){
+            errors[i] = e.what();
+        }
+    });
+
+    for(size_t i = 0; i < files.size(); ++i){
+        if(!errors[i].empty())
+            cerr << files[i] << ": " << errors[i] << endl;
+    }
+    cerr << "flags: " << inventory.strings() << " strings, "
+         << inventory.sets() << " sets" << endl;
+    inventory.write(cout);
+    return 0;
 }
 
 int main(int argc, char* argv[])
 {
+    if(argc >= 2 && strcmp(argv[1], "-x") == 0)
+        return translateAddrs(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-s") == 0)
+        return searchSymbols(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-w") == 0)
+        return watchDirs(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-b") == 0)
+        return scanBatch(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-u") == 0)
+        return findFdes(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-o") == 0)
+        return extractSections(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-S") == 0)
+        return streamSymbols(argc, argv);
+    if(argc >= 2 && strcmp(argv[1], "-g") == 0)
+        return inventoryFlags(argc, argv);
+
     if(argc != 2){
         printUsage();
         exit(1);
     }
 
     const char* filename = argv[1];
-    ELF elf(filename);
-    cout << "ELF Type: " << elf.e_type() << endl;
-
-    map<uint64_t, string> layout = makeLayout(elf);
-    for(auto it = layout.cbegin(); it != layout.cend(); ++it)
-        cout << Addr(it->first) << " " << it->second << endl;
-
-    vector<string> args = findGccCmdArgs(elf);
-    if(args.empty())
-        cout << "Gcc Args: N/A" << endl;
-    else{
-        cout << "Gcc Args:" << endl;
-        for(auto it = args.cbegin(); it != args.cend(); ++it)
-            cout << "  " << *it << endl;
+    if(isArchiveFile(filename)){
+        printArchive(cout, Archive(filename));
+        return 0;
     }
 
+    ELF elf(filename);
+    printElf(cout, elf);
     return 0;
 }
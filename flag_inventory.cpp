@@ -0,0 +1,113 @@
+#include <string>
+#include <vector>
+#include "flag_inventory.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+
+static constexpr uint32_t UNSEEN = ~(uint32_t)0;
+
+FlagInventory::FlagInventory(size_t files)
+    :records_(files)
+{
+}
+
+uint32_t FlagInventory::intern(const string &s)
+{
+    auto it = str_ids_.emplace(s, strs_.size()).first;
+    if(it->second == strs_.size())
+        strs_.push_back(&it->first);     // node keys never move
+    return it->second;
+}
+
+uint32_t FlagInventory::intern(const vector<string> &strs)
+{
+    vector<uint32_t> ids;
+    ids.reserve(strs.size());
+    for(const auto &s: strs)
+        ids.push_back(intern(s));
+
+    auto it = set_ids_.emplace(std::move(ids), sets_.size()).first;
+    if(it->second == sets_.size())
+        sets_.push_back(&it->first);
+    return it->second;
+}
+
+void FlagInventory::add(size_t file, const string &name, const vector<string> &args,
+        const vector<string> &comments)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t a = intern(args);
+    uint32_t c = intern(comments);
+    records_.at(file).push_back(Record{name, a, c});
+}
+
+size_t FlagInventory::strings() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return strs_.size();
+}
+
+size_t FlagInventory::sets() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sets_.size();
+}
+
+static void writeEscaped(std::ostream &os, const string &s)
+{
+    for(char c: s){
+        if(c == '\\')
+            os << "\\\\";
+        else if(c == '\n')
+            os << "\\n";
+        else
+            os << c;
+    }
+}
+
+void FlagInventory::write(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // renumber in order of first use
+    vector<uint32_t> str_out(strs_.size(), UNSEEN);
+    vector<uint32_t> set_out(sets_.size(), UNSEEN);
+    uint32_t nstrs = 0, nsets = 0;
+
+    auto emitSet = [&](uint32_t set){
+        if(set_out[set] != UNSEEN)
+            return set_out[set];
+
+        const auto &ids = *sets_[set];
+        for(uint32_t id: ids){
+            if(str_out[id] != UNSEEN)
+                continue;
+            str_out[id] = nstrs++;
+            os << "S " << str_out[id] << " ";
+            writeEscaped(os, *strs_[id]);
+            os << '\n';
+        }
+
+        set_out[set] = nsets++;
+        os << "A " << set_out[set];
+        for(uint32_t id: ids)
+            os << " " << str_out[id];
+        os << '\n';
+        return set_out[set];
+    };
+
+    for(const auto &records: records_){
+        for(const auto &rec: records){
+            uint32_t a = emitSet(rec.args);
+            uint32_t c = emitSet(rec.comments);
+            os << "F " << a << " " << c << " ";
+            writeEscaped(os, rec.name);
+            os << '\n';
+        }
+    }
+}
+
+} //namespace end
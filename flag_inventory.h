@@ -0,0 +1,58 @@
+#ifndef __FLAG_INVENTORY_H
+#define __FLAG_INVENTORY_H 1
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace iii{
+
+// Compiler flags and producer strings of many files, with every distinct
+// string and every distinct list of strings stored once.
+//
+// add() may be called from several threads; each call takes the lock once.
+class FlagInventory{
+public:
+    // `files` slots; several records (e.g. archive members) may share one
+    explicit FlagInventory(size_t files);
+
+    void add(size_t file, const std::string &name, const std::vector<std::string> &args,
+            const std::vector<std::string> &comments);
+
+    size_t strings() const;
+    size_t sets() const;
+
+    // Dictionary-encoded report, records in slot order:
+    //   S <id> <string>                    a string, first time it is used
+    //   A <id> <string-id>...              a list of strings, ditto
+    //   F <args-id> <comments-id> <name>   one record
+    // Ids are numbered in order of first use, so the output is the same
+    // whatever order add() ran in. '\' and newlines in strings are escaped.
+    void write(std::ostream &os) const;
+
+private:
+    struct Record{
+        std::string name;
+        uint32_t args;
+        uint32_t comments;
+    };
+
+    // the caller holds mutex_
+    uint32_t intern(const std::string &s);
+    uint32_t intern(const std::vector<std::string> &strs);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, uint32_t> str_ids_;
+    std::vector<const std::string*> strs_;
+    std::map<std::vector<uint32_t>, uint32_t> set_ids_;
+    std::vector<const std::vector<uint32_t>*> sets_;
+    std::vector<std::vector<Record>> records_;
+};
+
+} //namespace end
+
+#endif
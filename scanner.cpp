@@ -0,0 +1,618 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <ar.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#include "utils.h"
+#include "scanner.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+// read on its own before deciding whether to go on with a file
+static const size_t HEAD_SIZE = sizeof(Elf64_Ehdr);
+
+// reading the header brings at least this much of the file into the cache
+static const uint64_t FIRST_PAGE = 4096;
+
+static bool worthReading(const char *head, size_t len)
+{
+    return (len >= SELFMAG && memcmp(head, ELFMAG, SELFMAG) == 0) ||
+           (len >= SARMAG && memcmp(head, ARMAG, SARMAG) == 0);
+}
+
+// The section header table named by the ELF header in `head`, if it lies
+// in the file but not within its first page; otherwise size is 0.
+static void shdrTable(const char *head, size_t len, uint64_t file_size,
+        uint64_t &offset, uint64_t &size)
+{
+    uint64_t shnum, shentsize;
+    size = 0;
+    if(len < SELFMAG || memcmp(head, ELFMAG, SELFMAG) != 0)
+        return;
+    if(head[EI_CLASS] == ELFCLASS64 && len >= sizeof(Elf64_Ehdr)){
+        Elf64_Ehdr eh;
+        memcpy(&eh, head, sizeof(eh));
+        offset = eh.e_shoff;
+        shnum = eh.e_shnum;
+        shentsize = eh.e_shentsize;
+    }else if(head[EI_CLASS] == ELFCLASS32 && len >= sizeof(Elf32_Ehdr)){
+        Elf32_Ehdr eh;
+        memcpy(&eh, head, sizeof(eh));
+        offset = eh.e_shoff;
+        shnum = eh.e_shnum;
+        shentsize = eh.e_shentsize;
+    }else
+        return;
+
+    if(offset >= file_size || shentsize > 256)
+        return;
+    size = std::min(shnum * shentsize, file_size - offset);
+    if(offset + size <= FIRST_PAGE)
+        size = 0;
+}
+
+// blocking path: open, check the magic, map
+static void scanOne(const char *path, size_t i, const ScanCallback &fn)
+{
+    FileDesc fd(open(path, O_RDONLY | O_CLOEXEC));
+    if(fd.get() < 0){
+        fn(i, nullptr, errno);
+        return;
+    }
+
+    struct stat st;
+    if(fstat(fd.get(), &st) < 0){
+        fn(i, nullptr, errno);
+        return;
+    }
+    if(!S_ISREG(st.st_mode) || st.st_size == 0)
+        return;
+
+    char head[SARMAG];
+    ssize_t len;
+    while((len = pread(fd.get(), head, sizeof(head), 0)) < 0 && errno == EINTR)
+        ;
+    if(len < 0){
+        fn(i, nullptr, errno);
+        return;
+    }
+    if(!worthReading(head, len))
+        return;
+
+    shared_ptr<const MappedFile> file;
+    try{
+        file = std::make_shared<MappedFile>(fd.get(), st.st_size);
+    }catch(std::system_error &e){
+        fn(i, nullptr, e.code().value());
+        return;
+    }
+    fn(i, file, 0);
+}
+
+#ifdef HAVE_IO_URING
+namespace{
+
+// Bounded job queue drained by a fixed set of threads; push() blocks while
+// the queue is full so finished reads cannot pile up faster than parsing.
+class WorkQueue{
+public:
+    WorkQueue(unsigned threads, size_t capacity)
+        :capacity_(capacity), closed_(false)
+    {
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for(unsigned t = 0; t < threads; ++t)
+            threads_.emplace_back([this](){ work(); });
+    }
+
+    ~WorkQueue(){
+        close();
+    }
+
+    void push(std::function<void()> job){
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_.wait(lock, [this](){ return jobs_.size() < capacity_; });
+        jobs_.push_back(move(job));
+        ready_.notify_one();
+    }
+
+    // run the queued jobs to completion and rethrow the first failure
+    void finish(){
+        close();
+        if(error_)
+            std::rethrow_exception(error_);
+    }
+
+private:
+    void close(){
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(closed_)
+                return;
+            closed_ = true;
+        }
+        ready_.notify_all();
+        for(auto &th: threads_)
+            th.join();
+    }
+
+    void work(){
+        for(;;){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this](){ return closed_ || !jobs_.empty(); });
+                if(jobs_.empty())
+                    return;
+                job = move(jobs_.front());
+                jobs_.pop_front();
+                space_.notify_one();
+            }
+
+            try{
+                job();
+            }catch(...){
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(!error_)
+                    error_ = std::current_exception();
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    std::deque<std::function<void()>> jobs_;
+    vector<std::thread> threads_;
+    size_t capacity_;
+    bool closed_;
+    std::exception_ptr error_;
+};
+
+// Just enough of io_uring for the scanner, on the raw system calls.
+class Ring{
+public:
+    explicit Ring(unsigned entries);
+    ~Ring();
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    // whether the kernel implements all of `ops`
+    bool supports(std::initializer_list<uint8_t> ops) const;
+
+    // a zeroed SQE, or nullptr while the submission queue is full
+    struct io_uring_sqe *get_sqe();
+
+    // submit the queued SQEs and wait for `wait` completions; -errno on failure
+    int submit_and_wait(unsigned wait);
+
+    // fn(user_data, res) for every completion that has arrived
+    template<typename Fn>
+    void reap(Fn fn){
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head){
+            const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+            fn(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    void release();
+
+    int fd_;
+    void *sq_ring_ = MAP_FAILED;
+    void *cq_ring_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    struct io_uring_sqe *sqes_ = (struct io_uring_sqe*) MAP_FAILED;
+    size_t sqes_size_ = 0;
+
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    struct io_uring_cqe *cqes_;
+    unsigned tail_;         // SQ tail including SQEs not yet published
+};
+
+Ring::Ring(unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd_ < 0)
+        throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd_, IORING_OFF_SQ_RING);
+    if(sq_ring_ != MAP_FAILED && !single)
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    if(sq_ring_ != MAP_FAILED && (single || cq_ring_ != MAP_FAILED))
+        sqes_ = (struct io_uring_sqe*) mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if(sqes_ == MAP_FAILED){
+        int err = errno;
+        release();
+        throw std::system_error(err, std::generic_category(), "mmap io_uring");
+    }
+
+    char *sq = (char*) sq_ring_;
+    char *cq = (char*) (single ? sq_ring_ : cq_ring_);
+    sq_head_ = (unsigned*) (sq + params.sq_off.head);
+    sq_tail_ = (unsigned*) (sq + params.sq_off.tail);
+    sq_mask_ = *(unsigned*) (sq + params.sq_off.ring_mask);
+    sq_entries_ = *(unsigned*) (sq + params.sq_off.ring_entries);
+    cq_head_ = (unsigned*) (cq + params.cq_off.head);
+    cq_tail_ = (unsigned*) (cq + params.cq_off.tail);
+    cq_mask_ = *(unsigned*) (cq + params.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    tail_ = *sq_tail_;
+
+    // SQE i always sits in slot i of the index array
+    unsigned *array = (unsigned*) (sq + params.sq_off.array);
+    for(unsigned i = 0; i < sq_entries_; ++i)
+        array[i] = i;
+}
+
+Ring::~Ring()
+{
+    release();
+}
+
+void Ring::release()
+{
+    if(sqes_ != MAP_FAILED)
+        munmap(sqes_, sqes_size_);
+    if(cq_ring_ != MAP_FAILED)
+        munmap(cq_ring_, cq_ring_size_);
+    if(sq_ring_ != MAP_FAILED)
+        munmap(sq_ring_, sq_ring_size_);
+    close(fd_);
+}
+
+bool Ring::supports(std::initializer_list<uint8_t> ops) const
+{
+    const unsigned nops = 256;
+    vector<char> buf(sizeof(struct io_uring_probe) + nops * sizeof(struct io_uring_probe_op));
+    auto *probe = (struct io_uring_probe*) buf.data();
+    if(syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, nops) < 0)
+        return false;
+
+    for(uint8_t op: ops){
+        if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+struct io_uring_sqe *Ring::get_sqe()
+{
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if(tail_ - head >= sq_entries_)
+        return nullptr;
+
+    struct io_uring_sqe *sqe = &sqes_[tail_++ & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int Ring::submit_and_wait(unsigned wait)
+{
+    __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+    unsigned pending = tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if(pending == 0 && wait == 0)
+        return 0;
+
+    int ret = syscall(__NR_io_uring_enter, fd_, pending, wait,
+            wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+void prepRw(struct io_uring_sqe *sqe, uint8_t op, int fd, const void *addr,
+        uint32_t len, uint64_t off)
+{
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) addr;
+    sqe->len = len;
+    sqe->off = off;
+}
+
+// One file moving through openat+statx -> read head -> readahead of the
+// section headers.
+struct InFlight{
+    size_t index;
+    int fd = -1;
+    int waiting = 0;        // openat/statx completions outstanding
+    int error = 0;
+    struct statx stx;
+
+    char head[HEAD_SIZE];
+    size_t done = 0;        // bytes of head read so far
+};
+
+// the operation is kept in the low bits of the (aligned) InFlight pointer
+enum Op{ OP_OPEN = 1, OP_STATX = 2, OP_READ = 3, OP_ADVISE = 4 };
+static const uint64_t OP_MASK = 7;
+static_assert(alignof(InFlight) > OP_MASK, "no room for the operation");
+
+class UringScanner{
+public:
+    UringScanner(unsigned depth)
+        :ring_(depth * 4), depth_(depth),
+         advise_(ring_.supports({IORING_OP_FADVISE}))
+    {
+    }
+
+    bool supported() const{
+        return ring_.supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE});
+    }
+
+    void run(const vector<string> &paths, WorkQueue &queue, const ScanCallback &fn);
+
+private:
+    struct io_uring_sqe *get_sqe(){
+        struct io_uring_sqe *sqe;
+        while(!(sqe = ring_.get_sqe()))
+            ring_.submit_and_wait(0);
+        return sqe;
+    }
+
+    void start(InFlight *f, const char *path);
+    void opened(InFlight *f);
+    void submit_read(InFlight *f);
+    void head_done(InFlight *f);
+    void finish(InFlight *f, bool deliver);
+    void complete(uint64_t user_data, int res);
+
+    Ring ring_;
+    unsigned depth_;
+    bool advise_;           // IORING_OP_FADVISE is there (5.6 and later)
+    size_t inflight_ = 0;
+    size_t closing_ = 0;
+    WorkQueue *queue_ = nullptr;
+    const ScanCallback *fn_ = nullptr;
+};
+
+void UringScanner::start(InFlight *f, const char *path)
+{
+    // open and stat are independent, so both go out at once
+    f->waiting = 2;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    prepRw(sqe, IORING_OP_OPENAT, AT_FDCWD, path, 0, 0);
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = (uint64_t)f | OP_OPEN;
+
+    sqe = get_sqe();
+    prepRw(sqe, IORING_OP_STATX, AT_FDCWD, path, STATX_TYPE | STATX_SIZE, (uint64_t)&f->stx);
+    sqe->user_data = (uint64_t)f | OP_STATX;
+}
+
+void UringScanner::opened(InFlight *f)
+{
+    if(f->error){
+        finish(f, true);
+        return;
+    }
+    if(!S_ISREG(f->stx.stx_mode) || f->stx.stx_size == 0){
+        finish(f, false);
+        return;
+    }
+
+    submit_read(f);
+}
+
+void UringScanner::submit_read(InFlight *f)
+{
+    size_t len = std::min<uint64_t>(f->stx.stx_size, HEAD_SIZE) - f->done;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    prepRw(sqe, IORING_OP_READ, f->fd, f->head + f->done, len, f->done);
+    sqe->user_data = (uint64_t)f | OP_READ;
+}
+
+void UringScanner::head_done(InFlight *f)
+{
+    if(!worthReading(f->head, f->done)){
+        finish(f, false);
+        return;
+    }
+
+    // start readahead of the section headers rather than reading them
+    // into a buffer of our own; the parser maps them soon after
+    uint64_t offset, size;
+    shdrTable(f->head, f->done, f->stx.stx_size, offset, size);
+    if(size > 0 && advise_){
+        struct io_uring_sqe *sqe = get_sqe();
+        prepRw(sqe, IORING_OP_FADVISE, f->fd, nullptr, size, offset);
+        sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+        sqe->user_data = (uint64_t)f | OP_ADVISE;
+        return;
+    }
+    finish(f, true);
+}
+
+void UringScanner::finish(InFlight *f, bool deliver)
+{
+    shared_ptr<const MappedFile> file;
+    if(deliver && !f->error){
+        try{
+            file = std::make_shared<MappedFile>(f->fd, f->stx.stx_size);
+        }catch(std::system_error &e){
+            f->error = e.code().value();
+        }
+    }
+
+    if(f->fd >= 0){
+        struct io_uring_sqe *sqe = get_sqe();
+        prepRw(sqe, IORING_OP_CLOSE, f->fd, nullptr, 0, 0);
+        sqe->user_data = 0;
+        ++closing_;
+    }
+
+    if(deliver){
+        const ScanCallback *fn = fn_;
+        size_t index = f->index;
+        int error = f->error;
+        queue_->push([fn, index, file, error](){ (*fn)(index, file, error); });
+    }
+
+    --inflight_;
+    delete f;
+}
+
+void UringScanner::complete(uint64_t user_data, int res)
+{
+    if(user_data == 0){
+        --closing_;
+        return;
+    }
+
+    InFlight *f = (InFlight*)(user_data & ~OP_MASK);
+    switch(user_data & OP_MASK){
+    case OP_OPEN:
+        if(res < 0)
+            f->error = -res;
+        else
+            f->fd = res;
+        if(--f->waiting == 0)
+            opened(f);
+        break;
+
+    case OP_STATX:
+        if(res < 0 && !f->error)
+            f->error = -res;
+        if(--f->waiting == 0)
+            opened(f);
+        break;
+
+    case OP_READ:
+        if(res == -EINTR || res == -EAGAIN){
+            submit_read(f);
+        }else if(res < 0){
+            f->error = -res;
+            finish(f, true);
+        }else if(res == 0){
+            // the file shrank since statx
+            head_done(f);
+        }else{
+            f->done += res;
+            if(f->done < std::min<uint64_t>(f->stx.stx_size, HEAD_SIZE))
+                submit_read(f);
+            else
+                head_done(f);
+        }
+        break;
+
+    case OP_ADVISE:
+        // only a hint: a failure here does not stop the file being parsed
+        finish(f, true);
+        break;
+    }
+}
+
+void UringScanner::run(const vector<string> &paths, WorkQueue &queue, const ScanCallback &fn)
+{
+    queue_ = &queue;
+    fn_ = &fn;
+
+    size_t next = 0;
+    while(next < paths.size() || inflight_ > 0 || closing_ > 0){
+        while(inflight_ < depth_ && next < paths.size()){
+            InFlight *f = new InFlight();
+            f->index = next;
+            ++inflight_;
+            start(f, paths[next++].c_str());
+        }
+
+        int ret = ring_.submit_and_wait(1);
+        if(ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY)
+            throw std::system_error(-ret, std::generic_category(), "io_uring_enter");
+
+        ring_.reap([this](uint64_t user_data, int res){ complete(user_data, res); });
+    }
+}
+
+} //namespace
+#endif
+
+bool uringAvailable()
+{
+#ifdef HAVE_IO_URING
+    static const bool available = [](){
+        try{
+            return UringScanner(1).supported();
+        }catch(std::system_error&){
+            // e.g. io_uring disabled by seccomp or sysctl
+            return false;
+        }
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+void scanFiles(const vector<string> &paths, const ScanCallback &fn, const ScanOptions &opts)
+{
+#ifdef HAVE_IO_URING
+    if(opts.queue_depth > 0 && uringAvailable()){
+        std::unique_ptr<UringScanner> ring;
+        try{
+            ring.reset(new UringScanner(opts.queue_depth));
+        }catch(std::system_error&){
+            // e.g. RLIMIT_MEMLOCK too low for a ring this deep
+        }
+
+        if(ring){
+            WorkQueue queue(opts.threads, 2 * opts.queue_depth);
+            ring->run(paths, queue, fn);
+            queue.finish();
+            return;
+        }
+    }
+#endif
+
+    // thread-pool path: one blocking opener per thread, parsing inline
+    parallelFor(paths.size(), [&](size_t i){
+        scanOne(paths[i].c_str(), i, fn);
+    }, opts.threads);
+}
+
+} //end of namespace
@@ -0,0 +1,41 @@
+#ifndef __SCANNER_H
+#define __SCANNER_H 1
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils.h"
+
+namespace iii{
+
+// Called on a worker thread for paths[i]: `file` maps the whole file, and
+// only the pages the callback touches are read. If the file could not be
+// opened, stat'ed, read or mapped, `file` is null and `error` is the errno.
+typedef std::function<void(size_t i, std::shared_ptr<const MappedFile> file, int error)> ScanCallback;
+
+struct ScanOptions{
+    unsigned queue_depth = 64;  // files in flight; 0 selects the thread-pool path
+    unsigned threads = 0;       // parse workers (0: one per core)
+};
+
+// Open many files and hand each one to `fn` as soon as it is ready.
+// Files that start with neither the ELF nor the ar magic are dropped
+// without a callback.
+//
+// On io_uring, openat/statx/read/close for up to queue_depth files are
+// pipelined on one ring while a bounded pool of workers runs `fn`. The
+// ELF header of each file is read on its own, then, for ELF files,
+// readahead is started on the section header table it points to, so
+// parsing starts on headers that are already on their way into the page
+// cache. When the kernel refuses io_uring, or with queue depth 0, a pool
+// of `threads` threads opens, checks and maps the files with blocking
+// calls.
+void scanFiles(const std::vector<std::string> &paths, const ScanCallback &fn,
+        const ScanOptions &opts = ScanOptions());
+
+// whether scanFiles can use io_uring in this build and on this kernel
+bool uringAvailable();
+
+} //end of namespace
+#endif
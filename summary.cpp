@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "summary.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+using std::map;
+using std::ostringstream;
+
+static string str(ostringstream &sout)
+{
+    string s = sout.str();
+    sout.str("");
+    sout.clear();
+    return s;
+}
+
+map<uint64_t,string> makeLayout(const ELF &elf)
+{
+    ostringstream sout;
+    map<uint64_t,string> addrmap;
+
+    // Elf header ====
+    uint64_t offset = 0;
+    addrmap[offset] = "----EHdr-----"; 
+
+    offset = elf.e_size();
+    addrmap[offset] = "-------------";
+
+    // Program Header
+    if(elf.e_phnum() > 0){
+        offset = elf.e_phoff();
+        addrmap[offset] = "----Phdr-----"; 
+
+        for(size_t i = 0; i < elf.e_phnum(); ++i){
+            const auto &phdr = elf.phdr(i);
+            sout << "Phdr[" << i << "] " << phdr->p_type()
+                 << " " << Addr(phdr->p_offset())
+                 << "~" << Addr(phdr->p_offset() + phdr->p_filesz());
+            addrmap[offset] = str(sout);
+            offset += elf.e_phentsize();
+        }
+
+        addrmap[offset] = "-------------";
+    }
+
+    // Sections ======================================
+    if(elf.e_shnum() > 0){
+        offset = elf.shdr(0)->sh_offset();
+        addrmap[offset] = "---- Sections -----"; 
+
+        for(size_t i = 0; i < elf.e_shnum(); ++i){
+            const auto &shdr = elf.shdr(i);
+
+            offset = shdr->sh_offset();
+            sout << "Section[" << i << "] " << shdr->sh_type();
+            addrmap[offset] = str(sout);
+
+            offset += shdr->sh_size();
+            addrmap[offset] ="-------------";
+        }
+    }
+
+    // Section Header ===================
+    if(elf.e_shnum() > 0){
+        offset = elf.e_shoff();
+        addrmap[offset] ="----Shdr-----"; 
+
+        for(size_t i = 0; i < elf.e_shnum(); ++i){
+            const auto &shdr = elf.shdr(i);
+            const string &shname = elf.get_sh_name(i);
+            const auto &shtype = shdr->sh_type();
+
+            sout << "Shdr[" << i << "] " << shtype << " " << shname;
+            addrmap[offset] = str(sout);
+
+            offset += elf.e_shentsize();
+            addrmap[offset] = "-------------";
+        }
+    }
+
+    addrmap[elf.filesize()] =  "----EOF----";
+    return addrmap;
+}
+
+vector<string> findGccCmdArgs(const ELF &elf)
+{
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        const string &shname = elf.get_sh_name(i);
+        if(shname.compare(".GCC.command.line") == 0)
+            return elf.dump_section_strs(i);
+    }
+
+    return vector<string>{};
+}
+
+vector<string> findComments(const ELF &elf)
+{
+    vector<string> comments;
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        if(elf.get_sh_name(i) != ".comment")
+            continue;
+        // relocatable objects are not merged yet: drop repeats and padding
+        for(auto &s: elf.dump_section_strs(i)){
+            if(!s.empty() && std::find(comments.begin(), comments.end(), s) == comments.end())
+                comments.push_back(std::move(s));
+        }
+    }
+    return comments;
+}
+
+// walk the notes in [data, data + size) looking for the GNU build-id
+static string buildIdIn(const char *data, uint64_t size)
+{
+    uint64_t off = 0;
+    while(size - off >= sizeof(Elf64_Nhdr)){
+        // Elf32_Nhdr and Elf64_Nhdr have the same layout
+        Elf64_Nhdr nhdr;
+        memcpy(&nhdr, data + off, sizeof(nhdr));
+        off += sizeof(nhdr);
+
+        uint64_t name_at = off;
+        uint64_t desc_at = name_at + ((nhdr.n_namesz + 3) & ~3ull);
+        uint64_t next = desc_at + ((nhdr.n_descsz + 3) & ~3ull);
+        if(next > size)
+            break;
+
+        if(nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4 &&
+                memcmp(data + name_at, "GNU", 4) == 0){
+            static const char digits[] = "0123456789abcdef";
+            string id;
+            for(uint64_t i = 0; i < nhdr.n_descsz; ++i){
+                unsigned char c = data[desc_at + i];
+                id += digits[c >> 4];
+                id += digits[c & 0xf];
+            }
+            return id;
+        }
+        off = next;
+    }
+    return string();
+}
+
+string findBuildId(const ELF &elf)
+{
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        const auto &shdr = elf.shdr(i);
+        if(shdr->sh_type().value() != SHT_NOTE || shdr->sh_offset() > elf.filesize() ||
+                shdr->sh_size() > elf.filesize() - shdr->sh_offset())
+            continue;
+
+        string id = buildIdIn(elf.data() + shdr->sh_offset(), shdr->sh_size());
+        if(!id.empty())
+            return id;
+    }
+
+    // stripped of section headers; fall back to the note segments
+    for(size_t i = 0; i < elf.e_phnum(); ++i){
+        const auto &phdr = elf.phdr(i);
+        if(phdr->p_type().value() != PT_NOTE || phdr->p_offset() > elf.filesize() ||
+                phdr->p_filesz() > elf.filesize() - phdr->p_offset())
+            continue;
+
+        string id = buildIdIn(elf.data() + phdr->p_offset(), phdr->p_filesz());
+        if(!id.empty())
+            return id;
+    }
+    return string();
+}
+
+FileSummary makeSummary(const ELF &elf)
+{
+    ostringstream sout;
+    sout << elf.e_type();
+
+    FileSummary summary;
+    summary.type = sout.str();
+    summary.build_id = findBuildId(elf);
+    summary.gcc_args = findGccCmdArgs(elf);
+    summary.layout = makeLayout(elf);
+    return summary;
+}
+
+} //namespace end
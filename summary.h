@@ -0,0 +1,35 @@
+#ifndef __SUMMARY_H
+#define __SUMMARY_H 1
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "elf_bin.h"
+
+namespace iii{
+
+// file offset -> description of what starts there
+std::map<uint64_t,string> makeLayout(const ELF &elf);
+
+// contents of .GCC.command.line, one argument per entry
+vector<string> findGccCmdArgs(const ELF &elf);
+
+// producer strings in .comment, e.g. "GCC: (Debian 12.2.0-14) 12.2.0"
+vector<string> findComments(const ELF &elf);
+
+// NT_GNU_BUILD_ID as lowercase hex; empty if there is none
+string findBuildId(const ELF &elf);
+
+struct FileSummary{
+    string type;
+    string build_id;
+    vector<string> gcc_args;
+    std::map<uint64_t,string> layout;
+};
+
+FileSummary makeSummary(const ELF &elf);
+
+} //namespace end
+
+#endif
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sym_stream.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+
+WindowReader::WindowReader(int fd, uint64_t offset, uint64_t size, size_t window)
+    :fd_(fd), offset_(offset), size_(size),
+     buf_(std::max<size_t>(window, 256)), start_(0), filled_(0)
+{
+    posix_fadvise(fd_, offset_, size_, POSIX_FADV_SEQUENTIAL);
+}
+
+const char *WindowReader::at(uint64_t pos, size_t len)
+{
+    if(pos > size_ || len > size_ - pos)
+        throw std::invalid_argument("read past end of section");
+    if(len > buf_.size())
+        throw std::invalid_argument("read larger than window");
+
+    if(pos >= start_ && pos + len <= start_ + filled_)
+        return buf_.data() + (pos - start_);
+
+    // slide the window so that it starts at pos
+    start_ = pos;
+    filled_ = 0;
+    const size_t want = std::min<uint64_t>(buf_.size(), size_ - pos);
+    readAt(fd_, buf_.data(), want, offset_ + start_);
+    filled_ = want;
+    return buf_.data();
+}
+
+string WindowReader::str(uint64_t pos)
+{
+    string s;
+    while(pos < size_){
+        const char *p = at(pos, 1);
+        const size_t avail = this->avail(pos);
+        const char *nul = (const char*) memchr(p, '\0', avail);
+        if(nul){
+            s.append(p, nul - p);
+            break;
+        }
+        s.append(p, avail);
+        pos += avail;
+    }
+    return s;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+BlockCache::BlockCache(int fd, uint64_t offset, uint64_t size, size_t block_size, size_t blocks)
+    :fd_(fd), offset_(offset), size_(size),
+     block_size_(std::max<size_t>(block_size, 64)), blocks_(std::max<size_t>(blocks, 1)),
+     clock_(0)
+{
+    for(auto &b: blocks_){
+        b.start = 0;
+        b.len = 0;
+        b.used = 0;
+    }
+}
+
+const BlockCache::Block &BlockCache::block(uint64_t pos)
+{
+    const uint64_t start = pos / block_size_ * block_size_;
+    Block *victim = &blocks_[0];
+    for(auto &b: blocks_){
+        if(b.len > 0 && b.start == start){
+            b.used = ++clock_;
+            return b;
+        }
+        if(b.used < victim->used)
+            victim = &b;
+    }
+
+    victim->data.resize(block_size_);
+    victim->len = 0;
+    victim->start = start;
+    const size_t len = std::min<uint64_t>(block_size_, size_ - start);
+    readAt(fd_, victim->data.data(), len, offset_ + start);
+    victim->len = len;
+    victim->used = ++clock_;
+    return *victim;
+}
+
+string BlockCache::str(uint64_t pos)
+{
+    string s;
+    while(pos < size_){
+        const Block &b = block(pos);
+        const char *p = b.data.data() + (pos - b.start);
+        const size_t avail = b.start + b.len - pos;
+        const char *nul = (const char*) memchr(p, '\0', avail);
+        if(nul){
+            s.append(p, nul - p);
+            break;
+        }
+        s.append(p, avail);
+        pos += avail;
+    }
+    return s;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static int openOrThrow(const char *filename)
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        throw std::system_error(errno, std::generic_category(), filename);
+    return fd;
+}
+
+static size_t symEntsize(const ELF &elf, size_t section)
+{
+    if(section >= elf.e_shnum())
+        throw std::invalid_argument("no such section");
+
+    const auto &shdr = elf.shdr(section);
+    uint32_t type = shdr->sh_type().value();
+    if(type != SHT_SYMTAB && type != SHT_DYNSYM)
+        throw std::invalid_argument("not a symbol table");
+    if(shdr->sh_link() >= elf.e_shnum())
+        throw std::invalid_argument("invalid symbol string table");
+
+    const size_t symsize = (elf.e_ident_class() == ELFCLASS64) ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+    return shdr->sh_entsize() >= symsize ? shdr->sh_entsize() : symsize;
+}
+
+SymbolStream::SymbolStream(const char *filename, const ELF &elf, size_t section, size_t window)
+    :fd_(openOrThrow(filename)),
+     is64_(elf.e_ident_class() == ELFCLASS64),
+     entsize_(symEntsize(elf, section)),
+     count_(elf.shdr(section)->sh_size() / entsize_),
+     pos_(0),
+     syms_(fd_.get(), elf.shdr(section)->sh_offset(), count_ * entsize_, window),
+     strs_(fd_.get(), elf.shdr(elf.shdr(section)->sh_link())->sh_offset(),
+             elf.shdr(elf.shdr(section)->sh_link())->sh_size())
+{
+}
+
+bool SymbolStream::next(SymbolEntry &sym)
+{
+    if(pos_ >= count_)
+        return false;
+
+    const char *p = syms_.at(pos_ * entsize_, entsize_);
+    uint32_t st_name;
+    if(is64_){
+        Elf64_Sym s;
+        memcpy(&s, p, sizeof(s));
+        st_name = s.st_name;
+        sym.value = s.st_value;
+        sym.size = s.st_size;
+        sym.info = s.st_info;
+        sym.other = s.st_other;
+        sym.shndx = s.st_shndx;
+    }else{
+        Elf32_Sym s;
+        memcpy(&s, p, sizeof(s));
+        st_name = s.st_name;
+        sym.value = s.st_value;
+        sym.size = s.st_size;
+        sym.info = s.st_info;
+        sym.other = s.st_other;
+        sym.shndx = s.st_shndx;
+    }
+
+    sym.index = pos_++;
+    sym.name = (st_name < strs_.size()) ? strs_.str(st_name) : string();
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void forEachSectionStr(const char *filename, const ELF &elf, size_t i,
+        const std::function<void(const string&)> &fn, size_t window)
+{
+    if(i >= elf.e_shnum())
+        throw std::invalid_argument("no such section");
+
+    FileDesc fd(openOrThrow(filename));
+    const auto &shdr = elf.shdr(i);
+    WindowReader reader(fd.get(), shdr->sh_offset(), shdr->sh_size(), window);
+
+    // same splitting as splits_bin(): a trailing NUL does not start a string
+    string cur;
+    uint64_t pos = 0;
+    while(pos < reader.size()){
+        const char *p = reader.at(pos, 1);
+        const size_t avail = reader.avail(pos);
+        const char *nul = (const char*) memchr(p, '\0', avail);
+        if(nul){
+            cur.append(p, nul - p);
+            fn(cur);
+            cur.clear();
+            pos += nul - p + 1;
+        }else{
+            cur.append(p, avail);
+            pos += avail;
+        }
+    }
+    if(!cur.empty())
+        fn(cur);
+}
+
+} //namespace end
@@ -0,0 +1,111 @@
+#ifndef __SYM_STREAM_H
+#define __SYM_STREAM_H 1
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "utils.h"
+#include "elf_bin.h"
+
+namespace iii{
+
+// Reads [offset, offset + size) of a file through one fixed-size buffer,
+// refilled with pread whenever the cursor leaves it.
+class WindowReader{
+public:
+    WindowReader(int fd, uint64_t offset, uint64_t size, size_t window);
+
+    uint64_t size() const { return size_; }
+
+    // `len` bytes at `pos` (relative to the range), valid until the next
+    // call; len must not exceed the window
+    const char *at(uint64_t pos, size_t len);
+
+    // bytes buffered from `pos` onwards, right after at(pos, ...)
+    size_t avail(uint64_t pos) const { return start_ + filled_ - pos; }
+
+    // NUL-terminated string starting at `pos`, however long
+    string str(uint64_t pos);
+
+private:
+    int fd_;
+    uint64_t offset_;
+    uint64_t size_;
+    vector<char> buf_;
+    uint64_t start_;        // range position of buf_[0]
+    size_t filled_;
+};
+
+// Random access to [offset, offset + size) of a file through a few small
+// blocks, the least recently used one refilled on a miss. Suits string
+// tables, whose order rarely follows the symbols that point into them.
+class BlockCache{
+public:
+    BlockCache(int fd, uint64_t offset, uint64_t size,
+            size_t block_size = 256, size_t blocks = 64);
+
+    uint64_t size() const { return size_; }
+
+    // NUL-terminated string starting at `pos`, however long
+    string str(uint64_t pos);
+
+private:
+    struct Block{
+        uint64_t start;     // range position of data[0]
+        size_t len;
+        uint64_t used;      // value of clock_ at the last access
+        vector<char> data;
+    };
+
+    const Block &block(uint64_t pos);
+
+    int fd_;
+    uint64_t offset_;
+    uint64_t size_;
+    size_t block_size_;
+    vector<Block> blocks_;
+    uint64_t clock_;
+};
+
+struct SymbolEntry{
+    size_t index;
+    string name;
+    uint64_t value;
+    uint64_t size;
+    unsigned char info;
+    unsigned char other;
+    uint16_t shndx;
+};
+
+// Walks an SHT_SYMTAB/SHT_DYNSYM section through a sliding window and
+// looks names up in its string table through a BlockCache, so memory use
+// and the bytes read per symbol do not depend on the table size.
+class SymbolStream{
+public:
+    SymbolStream(const char *filename, const ELF &elf, size_t section,
+            size_t window = 1 << 20);
+
+    size_t size() const { return count_; }
+
+    // next symbol (starting at index 0); false once the table is exhausted
+    bool next(SymbolEntry &sym);
+
+private:
+    FileDesc fd_;
+    bool is64_;
+    size_t entsize_;
+    size_t count_;
+    size_t pos_;
+    WindowReader syms_;
+    BlockCache strs_;
+};
+
+// dump_section_strs() without loading the section: fn is called for each
+// NUL-separated string of section i in order.
+void forEachSectionStr(const char *filename, const ELF &elf, size_t i,
+        const std::function<void(const string&)> &fn, size_t window = 1 << 20);
+
+} //namespace end
+
+#endif
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "symsearch.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+
+void findAll(const char *data, size_t size, const string &needle, vector<uint64_t> &hits)
+{
+    const size_t n = needle.size();
+    if(n == 0 || n > size)
+        return;
+
+    const size_t last = size - n;   // last possible match position
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // compare the first and last needle bytes against 16 candidate
+    // positions at once; only positions matching both are verified
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last_byte = _mm_set1_epi8(needle[n-1]);
+    for(; i + 15 <= last; i += 16){
+        __m128i head = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i tail = _mm_loadu_si128((const __m128i*)(data + i + n - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last_byte)));
+        while(mask){
+            unsigned bit = __builtin_ctz(mask);
+            if(n <= 2 || memcmp(data + i + bit + 1, needle.data() + 1, n - 2) == 0)
+                hits.push_back(i + bit);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for(; i <= last; ++i){
+        if(data[i] == needle[0] && memcmp(data + i, needle.data(), n) == 0)
+            hits.push_back(i);
+    }
+}
+
+// index just past the bracket expression that starts at pattern[i] == '['
+static size_t skipBracket(const string &pattern, size_t i)
+{
+    size_t j = i + 1;
+    if(j < pattern.size() && pattern[j] == '^')
+        ++j;
+    if(j < pattern.size() && pattern[j] == ']')
+        ++j;
+    while(j < pattern.size() && pattern[j] != ']')
+        j += (pattern[j] == '\\') ? 2 : 1;
+    return j + 1;
+}
+
+// index just past the group that starts at pattern[i] == '('
+static size_t skipGroup(const string &pattern, size_t i)
+{
+    size_t depth = 0;
+    while(i < pattern.size()){
+        char c = pattern[i];
+        if(c == '\\'){
+            i += 2;
+            continue;
+        }
+        if(c == '['){
+            i = skipBracket(pattern, i);
+            continue;
+        }
+        ++i;
+        if(c == '(')
+            ++depth;
+        else if(c == ')' && --depth == 0)
+            break;
+    }
+    return i;
+}
+
+// length of the alphanumeric escape at pattern[i] == '\\'
+static size_t escapeLength(const string &pattern, size_t i)
+{
+    if(i + 1 >= pattern.size())
+        return 1;
+    switch(pattern[i+1]){
+    case 'x': return 4;     // \xHH
+    case 'u': return 6;     // \uHHHH
+    case 'c': return 3;     // \cX
+    default: break;
+    }
+
+    // back-reference (\1, \12, ...) or \0
+    size_t j = i + 1;
+    while(j < pattern.size() && isdigit((unsigned char)pattern[j]))
+        ++j;
+    return j > i + 1 ? j - i : 2;
+}
+
+string requiredLiteral(const string &pattern)
+{
+    if(pattern.find('|') != string::npos)
+        return string();
+
+    string best, run;
+    auto flush = [&best, &run](){
+        if(run.size() > best.size())
+            best = run;
+        run.clear();
+    };
+
+    for(size_t i = 0; i < pattern.size(); ){
+        char c = pattern[i];
+        char lit;
+        size_t next;
+
+        if(c == '\\' && i + 1 < pattern.size() && !isalnum((unsigned char)pattern[i+1])){
+            lit = pattern[i+1];
+            next = i + 2;
+        }else if(c == '\\'){
+            // class escape (\d, \w, ...), character code or back-reference
+            flush();
+            i += escapeLength(pattern, i);
+            continue;
+        }else if(c == '['){
+            flush();
+            i = skipBracket(pattern, i);
+            continue;
+        }else if(c == '('){
+            // the group may be optional or repeated: none of it is required
+            flush();
+            i = skipGroup(pattern, i);
+            continue;
+        }else if(c == '{'){
+            // skip the whole {m,n} quantifier
+            flush();
+            size_t close = pattern.find('}', i);
+            i = (close == string::npos) ? pattern.size() : close + 1;
+            continue;
+        }else if(strchr(".^$?*+)}]", c)){
+            flush();
+            ++i;
+            continue;
+        }else{
+            lit = c;
+            next = i + 1;
+        }
+
+        // a quantifier after the character makes it optional
+        if(next < pattern.size() && strchr("?*{", pattern[next])){
+            flush();
+            i = next;
+            continue;
+        }
+
+        run += lit;
+        i = next;
+    }
+
+    flush();
+    return best;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+SymbolMatcher::SymbolMatcher(const string &pattern, bool is_regex)
+    :literal_(is_regex ? requiredLiteral(pattern) : pattern),
+     is_regex_(is_regex)
+{
+    if(is_regex_)
+        regex_ = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+}
+
+vector<SymbolHit> SymbolMatcher::search(const ELF &elf) const
+{
+    vector<SymbolHit> hits;
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        uint32_t type = elf.shdr(i)->sh_type().value();
+        if(type == SHT_SYMTAB || type == SHT_DYNSYM)
+            search_section(elf, i, hits);
+    }
+    return hits;
+}
+
+static bool inFile(const ELF &elf, const unique_ptr<Shdr> &shdr)
+{
+    return shdr->sh_type().value() != SHT_NOBITS &&
+           shdr->sh_offset() <= elf.filesize() &&
+           shdr->sh_size() <= elf.filesize() - shdr->sh_offset();
+}
+
+void SymbolMatcher::search_section(const ELF &elf, size_t i, vector<SymbolHit> &hits) const
+{
+    const auto &symtab = elf.shdr(i);
+    if(symtab->sh_link() >= elf.e_shnum())
+        return;
+    const auto &strtab = elf.shdr(symtab->sh_link());
+    if(!inFile(elf, symtab) || !inFile(elf, strtab))
+        return;
+
+    const bool is64 = elf.e_ident_class() == ELFCLASS64;
+    const size_t symsize = is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+    const size_t shndx_at = is64 ? offsetof(Elf64_Sym, st_shndx) : offsetof(Elf32_Sym, st_shndx);
+    const size_t entsize = symtab->sh_entsize() ? symtab->sh_entsize() : symsize;
+    if(entsize < symsize)
+        return;
+
+    const char *syms = elf.data() + symtab->sh_offset();
+    const size_t count = symtab->sh_size() / entsize;
+    const char *strs = elf.data() + strtab->sh_offset();
+    const size_t strs_size = strtab->sh_size();
+
+    // literal hits, and the start of the string each one lies in
+    vector<uint64_t> found;
+    vector<uint64_t> starts;
+    if(!literal_.empty()){
+        findAll(strs, strs_size, literal_, found);
+        if(found.empty())
+            return;
+
+        starts.reserve(found.size());
+        for(uint64_t h: found){
+            const char *nul = (const char*) memrchr(strs, '\0', h);
+            starts.push_back(nul ? nul - strs + 1 : 0);
+        }
+    }
+
+    for(size_t k = 1; k < count; ++k){
+        const char *sym = syms + k * entsize;
+        uint32_t st_name;
+        memcpy(&st_name, sym, sizeof(st_name));
+        if(st_name >= strs_size)
+            continue;
+
+        // the name contains a hit iff the first hit at or after st_name
+        // is still inside the same NUL-terminated string
+        if(!literal_.empty()){
+            auto it = std::lower_bound(found.cbegin(), found.cend(), (uint64_t)st_name);
+            if(it == found.cend() || starts[it - found.cbegin()] > st_name)
+                continue;
+        }
+
+        const char *name = strs + st_name;
+        string sname(name, strnlen(name, strs_size - st_name));
+        if(is_regex_ && !std::regex_search(sname, regex_))
+            continue;
+
+        uint16_t shndx;
+        memcpy(&shndx, sym + shndx_at, sizeof(shndx));
+        hits.push_back(SymbolHit{i, k, move(sname), shndx != SHN_UNDEF});
+    }
+}
+
+} //namespace end
@@ -0,0 +1,50 @@
+#ifndef __SYMSEARCH_H
+#define __SYMSEARCH_H 1
+
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+#include "elf_bin.h"
+
+namespace iii{
+
+struct SymbolHit{
+    size_t section;     // index of the SYMTAB/DYNSYM section
+    size_t index;       // symbol index inside that section
+    string name;
+    bool defined;       // false for undefined (referenced) symbols
+};
+
+// Substring or regex search over symbol names.
+//
+// The string tables are scanned in place for a literal (the pattern itself,
+// or the longest literal every regex match must contain), and only the
+// symbols whose names contain a hit are decoded; the regex, if any, then
+// confirms the candidates.
+class SymbolMatcher{
+public:
+    SymbolMatcher(const string &pattern, bool is_regex = false);
+
+    const string &literal() const { return literal_; }
+
+    vector<SymbolHit> search(const ELF &elf) const;
+
+private:
+    void search_section(const ELF &elf, size_t i, vector<SymbolHit> &hits) const;
+
+    string literal_;
+    bool is_regex_;
+    std::regex regex_;
+};
+
+// Longest literal that every match of the ECMAScript regex contains;
+// empty when there is none (e.g. the pattern has an alternation).
+string requiredLiteral(const string &pattern);
+
+// Offsets of every occurrence of `needle` in [data, data + size).
+void findAll(const char *data, size_t size, const string &needle, vector<uint64_t> &hits);
+
+} //namespace end
+
+#endif
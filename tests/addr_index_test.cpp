@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <elf.h>
+#include "addr_index.h"
+#include "check.h"
+
+using namespace iii;
+
+// An ET_DYN image with only an ELF header and PT_LOAD entries, linked at
+// 0x10000000 like the shared libraries that exposed the bias bugs.
+static std::shared_ptr<std::string> makeImage()
+{
+    struct Load{ uint64_t offset, vaddr, filesz, memsz; };
+    const Load loads[] = {
+        {0x0000, 0x10000000, 0x450, 0x450},
+        {0x1000, 0x10001000, 0x13d, 0x13d},
+        {0x2000, 0x10002000, 0x0b8, 0x0b8},
+        {0x2e38, 0x10003e38, 0x1d8, 0x1e0},
+    };
+    const size_t nload = sizeof(loads) / sizeof(loads[0]);
+
+    Elf64_Ehdr eh;
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_DYN;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_ehsize = sizeof(eh);
+    eh.e_phoff = sizeof(eh);
+    eh.e_phentsize = sizeof(Elf64_Phdr);
+    eh.e_phnum = nload;
+
+    auto image = std::make_shared<std::string>(0x3010, '\0');
+    memcpy(&(*image)[0], &eh, sizeof(eh));
+    for(size_t i = 0; i < nload; ++i){
+        Elf64_Phdr ph;
+        memset(&ph, 0, sizeof(ph));
+        ph.p_type = PT_LOAD;
+        ph.p_offset = loads[i].offset;
+        ph.p_vaddr = ph.p_paddr = loads[i].vaddr;
+        ph.p_filesz = loads[i].filesz;
+        ph.p_memsz = loads[i].memsz;
+        ph.p_align = 0x1000;
+        memcpy(&(*image)[sizeof(eh) + i * sizeof(ph)], &ph, sizeof(ph));
+    }
+    return image;
+}
+
+// the batch results must equal the scalar ones for every address
+static void checkBatch(const AddrIndex &index, std::vector<uint64_t> vaddrs)
+{
+    std::sort(vaddrs.begin(), vaddrs.end());
+    std::vector<uint64_t> offsets(vaddrs.size());
+    index.vaddrs_to_offsets(vaddrs.data(), vaddrs.size(), offsets.data());
+    for(size_t i = 0; i < vaddrs.size(); ++i)
+        CHECK(offsets[i] == index.vaddr_to_offset(vaddrs[i]));
+}
+
+int main()
+{
+    auto image = makeImage();
+    ELF elf(image, image->data(), image->size());
+
+    // no load base: link-time addresses
+    AddrIndex link(elf);
+    CHECK(link.bias() == 0);
+    CHECK(link.vaddr_to_offset(0x10001100) == 0x1100);
+    CHECK(link.vaddr_to_offset(0x10003f00) == 0x2f00);
+    CHECK(link.vaddr_to_offset(0x10004014) == AddrIndex::NOT_MAPPED);     // .bss tail
+    CHECK(link.offset_to_vaddr(0x1100) == 0x10001100);
+
+    // load base above, below and at the link address
+    AddrIndex above(elf, 0x7f0000000000);
+    CHECK(above.vaddr_to_offset(0x7f0000001100) == 0x1100);
+    AddrIndex below(elf, 0x8000000);
+    CHECK(below.vaddr_to_offset(0x8001100) == 0x1100);
+    AddrIndex same(elf, 0x10000000);
+    CHECK(same.bias() == 0);
+
+    uint64_t one = 0x8001100, out = 0;
+    below.vaddrs_to_offsets(&one, 1, &out);
+    CHECK(out == 0x1100);
+
+    std::mt19937_64 rng(1);
+    for(const AddrIndex *index: {&link, &above, &below, &same}){
+        std::vector<uint64_t> vaddrs = {0, 1, ~(uint64_t)0, index->bias(), index->bias() - 1};
+        for(int i = 0; i < 2000; ++i){
+            // mostly near the image, some anywhere
+            uint64_t base = 0x10000000 + index->bias();
+            vaddrs.push_back(i % 4 ? base - 0x1000 + rng() % 0x6000 : rng());
+        }
+        checkBatch(*index, vaddrs);
+    }
+
+    bool threw = false;
+    uint64_t unsorted[] = {2, 1};
+    uint64_t res[2];
+    try{
+        link.vaddrs_to_offsets(unsorted, 2, res);
+    }catch(std::invalid_argument&){
+        threw = true;
+    }
+    CHECK(threw);
+
+    return checkResult("addr_index_test");
+}
@@ -0,0 +1,26 @@
+#ifndef __TESTS_CHECK_H
+#define __TESTS_CHECK_H 1
+
+#include <iostream>
+
+// Minimal assertion helpers shared by the test programs: a failed CHECK
+// is reported and counted, and main() returns checkResult().
+static int check_failures = 0;
+
+#define CHECK(cond) do{ \
+        if(!(cond)){ \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+            ++check_failures; \
+        } \
+    }while(0)
+
+static inline int checkResult(const char *name)
+{
+    if(check_failures)
+        std::cerr << name << ": " << check_failures << " check(s) failed" << std::endl;
+    else
+        std::cout << name << ": ok" << std::endl;
+    return check_failures ? 1 : 0;
+}
+
+#endif
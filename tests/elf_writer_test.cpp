@@ -0,0 +1,202 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <elf.h>
+#include <unistd.h>
+#include "elf_writer.h"
+#include "utils.h"
+#include "check.h"
+
+using namespace iii;
+
+// .text, .data, .comment, .symtab, .strtab, .shstrtab; with `exec`, an
+// ET_EXEC whose one PT_LOAD covers the headers, .text and .data.
+static std::string makeImage(bool exec)
+{
+    static const char strtab[] = "\0f\0d";
+    static const char shstrtab[] = "\0.text\0.data\0.comment\0.symtab\0.strtab\0.shstrtab";
+    const uint64_t base = 0x400000;
+
+    std::string image(0x3c0, '\0');
+    auto put = [&image](uint64_t offset, const void *p, size_t len){
+        memcpy(&image[offset], p, len);
+    };
+
+    Elf64_Ehdr eh;
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = exec ? ET_EXEC : ET_REL;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_ehsize = sizeof(eh);
+    eh.e_shoff = 0x200;
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = 7;
+    eh.e_shstrndx = 6;
+    if(exec){
+        eh.e_phoff = sizeof(eh);
+        eh.e_phentsize = sizeof(Elf64_Phdr);
+        eh.e_phnum = 1;
+
+        Elf64_Phdr ph;
+        memset(&ph, 0, sizeof(ph));
+        ph.p_type = PT_LOAD;
+        ph.p_flags = PF_R | PF_X;
+        ph.p_vaddr = ph.p_paddr = base;
+        ph.p_filesz = ph.p_memsz = 0x118;
+        ph.p_align = 0x1000;
+        put(eh.e_phoff, &ph, sizeof(ph));
+    }
+    put(0, &eh, sizeof(eh));
+
+    memset(&image[0x100], 0x90, 16);    // .text
+    put(0x118, "GCC", 4);               // .comment
+
+    Elf64_Sym syms[3];
+    memset(syms, 0, sizeof(syms));
+    syms[1].st_name = 1;                // f in .text
+    syms[1].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+    syms[1].st_shndx = 1;
+    syms[1].st_value = exec ? base + 0x104 : 4;
+    syms[2].st_name = 3;                // d in .data
+    syms[2].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+    syms[2].st_shndx = 2;
+    syms[2].st_value = exec ? base + 0x110 : 0;
+    put(0x120, syms, sizeof(syms));
+    put(0x168, strtab, sizeof(strtab));
+    put(0x170, shstrtab, sizeof(shstrtab));
+
+    struct Sec{ uint32_t name, type; uint64_t flags, offset, size; uint32_t link, info; uint64_t entsize; };
+    const Sec secs[] = {
+        {0, SHT_NULL, 0, 0, 0, 0, 0, 0},
+        {1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0x100, 16, 0, 0, 0},
+        {7, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 0x110, 8, 0, 0, 0},
+        {13, SHT_PROGBITS, 0, 0x118, 4, 0, 0, 0},
+        {22, SHT_SYMTAB, 0, 0x120, sizeof(syms), 5, 1, sizeof(Elf64_Sym)},
+        {30, SHT_STRTAB, 0, 0x168, sizeof(strtab), 0, 0, 0},
+        {38, SHT_STRTAB, 0, 0x170, sizeof(shstrtab), 0, 0, 0},
+    };
+    for(size_t i = 0; i < 7; ++i){
+        Elf64_Shdr sh;
+        memset(&sh, 0, sizeof(sh));
+        sh.sh_name = secs[i].name;
+        sh.sh_type = secs[i].type;
+        sh.sh_flags = secs[i].flags;
+        sh.sh_addr = (exec && (secs[i].flags & SHF_ALLOC)) ? base + secs[i].offset : 0;
+        sh.sh_offset = secs[i].offset;
+        sh.sh_size = secs[i].size;
+        sh.sh_link = secs[i].link;
+        sh.sh_info = secs[i].info;
+        sh.sh_addralign = 1;
+        sh.sh_entsize = secs[i].entsize;
+        put(eh.e_shoff + i * sizeof(sh), &sh, sizeof(sh));
+    }
+    return image;
+}
+
+static std::string writeTemp(const std::string &data)
+{
+    char path[] = "/tmp/elf_writer_test.XXXXXX";
+    FileDesc fd(mkstemp(path));
+    CHECK(fd.get() >= 0);
+    CHECK(write(fd.get(), data.data(), data.size()) == (ssize_t)data.size());
+    return path;
+}
+
+static size_t sectionIndex(const ELF &elf, const std::string &name)
+{
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        if(elf.get_sh_name(i) == name)
+            return i;
+    }
+    return 0;
+}
+
+static Elf64_Sym symbol(const ELF &elf, size_t symtab, size_t i)
+{
+    Elf64_Sym sym;
+    memcpy(&sym, elf.dump_section(symtab).data() + i * sizeof(sym), sizeof(sym));
+    return sym;
+}
+
+int main()
+{
+    const std::string src = writeTemp(makeImage(false));
+    const std::string dst = src + ".out";
+
+    // drop .data: the sections after it move down by one
+    {
+        ELF elf(src.c_str());
+        CHECK(!writeSections(elf, src.c_str(), dst.c_str(), selectSections(elf, {}, {".data"})));
+
+        ELF out(dst.c_str());
+        CHECK(out.e_shnum() == 6);
+        CHECK(sectionIndex(out, ".data") == 0);
+        const size_t symtab = sectionIndex(out, ".symtab");
+        CHECK(symtab == 3);
+        CHECK(out.get_sh_name(out.shdr(symtab)->sh_link()) == ".strtab");
+        CHECK(out.get_sh_name(out.e_shstrndx()) == ".shstrtab");
+        CHECK(out.dump_section(sectionIndex(out, ".comment")) == std::string("GCC", 4));
+
+        Elf64_Sym f = symbol(out, symtab, 1);
+        CHECK(out.get_sh_name(f.st_shndx) == ".text");
+        CHECK(f.st_value == 4);
+
+        // symbols of the dropped section keep their value, as absolutes
+        Elf64_Sym d = symbol(out, symtab, 2);
+        CHECK(d.st_shndx == SHN_ABS);
+        CHECK(d.st_value == 0);
+    }
+
+    // keeping indices leaves the dropped section as an empty entry
+    {
+        ELF elf(src.c_str());
+        writeSections(elf, src.c_str(), dst.c_str(), selectSections(elf, {}, {".data"}), true);
+
+        ELF out(dst.c_str());
+        CHECK(out.e_shnum() == 7);
+        CHECK(out.shdr(2)->sh_type().value() == SHT_NOBITS);
+        CHECK(symbol(out, 4, 2).st_shndx == 2);
+    }
+
+    // a dangling sh_link is refused and leaves the old output alone
+    {
+        ELF elf(src.c_str());
+        bool refused = false;
+        try{
+            writeSections(elf, src.c_str(), dst.c_str(), selectSections(elf, {}, {".strtab"}));
+        }catch(std::invalid_argument&){
+            refused = true;
+        }
+        CHECK(refused);
+        CHECK(ELF(dst.c_str()).e_shnum() == 7);
+    }
+    unlink(src.c_str());
+
+    // an executable keeps its program headers and loaded layout unless an
+    // allocated section goes
+    const std::string exe = writeTemp(makeImage(true));
+    {
+        ELF elf(exe.c_str());
+        CHECK(writeSections(elf, exe.c_str(), dst.c_str(), selectSections(elf, {}, {".comment"})));
+
+        ELF out(dst.c_str());
+        CHECK(out.e_phnum() == 1);
+        CHECK(out.phdr(0)->p_filesz() == 0x118);
+        CHECK(out.shdr(sectionIndex(out, ".text"))->sh_offset() == 0x100);
+        CHECK(out.shdr(sectionIndex(out, ".data"))->sh_offset() == 0x110);
+        CHECK(std::string(out.data() + 0x40, 0xd8) == std::string(elf.data() + 0x40, 0xd8));
+        CHECK(out.get_sh_name(symbol(out, sectionIndex(out, ".symtab"), 2).st_shndx) == ".data");
+
+        CHECK(!writeSections(elf, exe.c_str(), dst.c_str(), selectSections(elf, {}, {".data"})));
+        CHECK(ELF(dst.c_str()).e_phnum() == 0);
+    }
+    unlink(exe.c_str());
+    unlink(dst.c_str());
+
+    return checkResult("elf_writer_test");
+}
@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <regex>
+#include <string>
+#include <vector>
+#include "symsearch.h"
+#include "check.h"
+
+using namespace iii;
+
+// every string the regex matches must contain the extracted literal
+static void checkLiteral(const std::string &pattern, const std::vector<std::string> &matches)
+{
+    const std::string literal = requiredLiteral(pattern);
+    const std::regex re(pattern, std::regex::ECMAScript);
+    for(const auto &m: matches){
+        CHECK(std::regex_search(m, re));
+        CHECK(m.find(literal) != std::string::npos);
+    }
+}
+
+static bool finds(const ELF &elf, const std::string &pattern, const std::string &name)
+{
+    auto hits = SymbolMatcher(pattern, true).search(elf);
+    return std::any_of(hits.begin(), hits.end(),
+            [&name](const SymbolHit &hit){ return hit.name == name; });
+}
+
+// never inlined, so it keeps a symbol of its own
+__attribute__((noinline)) int probe_symbol_target(int x)
+{
+    return x * 3;
+}
+
+int main()
+{
+    CHECK(requiredLiteral("main") == "main");
+    CHECK(requiredLiteral("^_ZN4iii3ELF.*") == "_ZN4iii3ELF");
+    CHECK(requiredLiteral("ab+c") == "ab");
+    CHECK(requiredLiteral("foo|bar") == "");
+
+    // quantifier bodies, groups and multi-character escapes are not literals
+    checkLiteral("ma{1,2}in", {"main", "maain"});
+    checkLiteral("(start_)?main", {"main", "start_main"});
+    checkLiteral("(ab)+cd", {"abcd", "ababcd"});
+    checkLiteral("x(a(b)c)*yz", {"xyz", "xabcyz"});
+    checkLiteral("m\\x61in", {"main"});
+    checkLiteral("m\\u0061in", {"main"});
+    CHECK(requiredLiteral("\\cJmain") == "main");     // libstdc++ lacks \cX
+    checkLiteral("(a)\\1main", {"aamain"});
+    checkLiteral("ma[i\\]]{2}n", {"maiin", "ma]in"});
+
+    // end to end on this test program's own symbol table
+    ELF elf("/proc/self/exe");
+    CHECK(finds(elf, "^main$", "main"));
+    CHECK(finds(elf, "^ma{1,2}in$", "main"));
+    CHECK(finds(elf, "^(start_)?main$", "main"));
+    CHECK(finds(elf, "^m\\x61in$", "main"));
+    CHECK(finds(elf, "probe_sym(bol)?_target", "_Z19probe_symbol_targeti"));
+
+    return checkResult("symsearch_test") + (probe_symbol_target(0) != 0);
+}
@@ -1,6 +1,19 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <system_error>
+#include <exception>
+#include <stdexcept>
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "utils.h"
 
 namespace iii{
@@ -19,4 +32,118 @@ std::string readFile(const char *filename)
     return std::string(buffer.get(), length);
 }
 
+void readAt(int fd, char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while(done < len){
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+            throw std::system_error(errno, std::generic_category(), "pread");
+        if(n == 0)
+            throw std::runtime_error("unexpected end of file");
+        done += n;
+    }
+}
+
+FileDesc::~FileDesc()
+{
+    if(fd_ >= 0)
+        close(fd_);
+}
+
+MappedFile::MappedFile(const char *filename)
+    :data_(nullptr), size_(0)
+{
+    FileDesc fd(open(filename, O_RDONLY | O_CLOEXEC));
+    if(fd.get() < 0)
+        throw std::system_error(errno, std::generic_category(), filename);
+
+    struct stat st;
+    if(fstat(fd.get(), &st) < 0)
+        throw std::system_error(errno, std::generic_category(), filename);
+
+    size_ = st.st_size;
+    map(fd.get(), filename);
+}
+
+MappedFile::MappedFile(int fd, size_t size)
+    :data_(nullptr), size_(size)
+{
+    map(fd, "mmap");
+}
+
+void MappedFile::map(int fd, const char *what)
+{
+    if(size_ == 0)
+        return;
+
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), what);
+    data_ = (const char*) addr;
+}
+
+MappedFile::~MappedFile()
+{
+    if(data_)
+        munmap((void*)data_, size_);
+}
+
+std::vector<std::string> listFiles(const std::vector<std::string> &paths)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> files;
+    for(const auto &path: paths){
+        if(!fs::is_directory(path)){
+            files.push_back(path);
+            continue;
+        }
+
+        std::error_code ec;
+        auto it = fs::recursive_directory_iterator(path,
+                fs::directory_options::skip_permission_denied, ec);
+        for(; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)){
+            if(it->is_regular_file(ec))
+                files.push_back(it->path().string());
+        }
+    }
+    return files;
+}
+
+void parallelFor(size_t n, const std::function<void(size_t)> &fn, unsigned threads)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if(threads > n)
+        threads = n;
+
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+
+    auto worker = [&](){
+        for(size_t i = next++; i < n && !failed; i = next++){
+            try{
+                fn(i);
+            }catch(...){
+                if(!failed.exchange(true))
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for(auto &th: pool)
+        th.join();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
 } //end of namespace
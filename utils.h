@@ -1,13 +1,63 @@
 #ifndef __TTT_UTILS_H
 #define __TTT_UTILS_H 1
 
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <functional>
+#include <vector>
 
 namespace iii{
 
 std::string readFile(const char *filename);
 
+// pread exactly `len` bytes at `offset`; hitting EOF first is an error
+void readAt(int fd, char *buf, size_t len, uint64_t offset);
+
+// Owns a file descriptor; closes it on destruction.
+class FileDesc{
+public:
+    FileDesc(int fd): fd_(fd){}
+    ~FileDesc();
+
+    FileDesc(const FileDesc&) = delete;
+    FileDesc& operator=(const FileDesc&) = delete;
+
+    int get() const { return fd_; }
+private:
+    int fd_;
+};
+
+// Read-only private mapping of a whole file.
+class MappedFile{
+public:
+    MappedFile(const char *filename);
+
+    // map `size` bytes of an open file; the descriptor stays the caller's
+    MappedFile(int fd, size_t size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void map(int fd, const char *what);
+
+    const char *data_;
+    size_t size_;
+};
+
+// Regular files named by `paths`, with directories expanded recursively.
+std::vector<std::string> listFiles(const std::vector<std::string> &paths);
+
+// Run fn(0) .. fn(n-1) on up to `threads` worker threads (0: one per core).
+// Items are handed out one at a time, so uneven work still balances.
+void parallelFor(size_t n, const std::function<void(size_t)> &fn, unsigned threads = 0);
+
 class OstreamFlagRecover{
 public:
     OstreamFlagRecover(std::ostream &os)
@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utils.h"
+#include "watcher.h"
+
+namespace iii{
+
+using std::string;
+using std::vector;
+using std::lock_guard;
+using std::mutex;
+namespace chrono = std::chrono;
+
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                   IN_CREATE | IN_DELETE | IN_DELETE_SELF;
+
+static bool isBelow(const string &path, const string &dir)
+{
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+           path[dir.size()] == '/';
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// pread [offset, offset + len) of the file into the same place in buf,
+// ignoring ranges that lie outside it (parsing rejects those later)
+static void fill(int fd, char *buf, uint64_t size, uint64_t offset, uint64_t len)
+{
+    if(offset < size)
+        readAt(fd, buf + offset, std::min(len, size - offset), offset);
+}
+
+// Summary of a file that a build may be rewriting under us. Mapping it
+// would fault (SIGBUS) if it were truncated meanwhile, so the headers and
+// the sections makeSummary() reads are pread into an anonymous zero-filled
+// image of the file instead; the pages it never touches cost nothing.
+static FileSummary readSummary(const string &path)
+{
+    FileDesc fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if(fd.get() < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+
+    struct stat st;
+    if(fstat(fd.get(), &st) < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+    const uint64_t size = st.st_size;
+    if(size < EI_NIDENT)
+        throw std::invalid_argument("invalid elf header len");
+
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(addr == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), "mmap");
+    std::shared_ptr<void> image(addr, [size](void *p){ munmap(p, size); });
+    char *buf = (char*) addr;
+
+    fill(fd.get(), buf, size, 0, sizeof(Elf64_Ehdr));
+    {
+        // the tables read as zeros until they are filled in
+        ELF head(image, buf, size);
+        fill(fd.get(), buf, size, head.e_phoff(), (uint64_t)head.e_phnum() * head.e_phentsize());
+        fill(fd.get(), buf, size, head.e_shoff(), (uint64_t)head.e_shnum() * head.e_shentsize());
+    }
+
+    ELF elf(image, buf, size);
+    if(elf.e_shnum() > 0){
+        const auto &shstrtab = elf.shdr(elf.e_shstrndx());
+        fill(fd.get(), buf, size, shstrtab->sh_offset(), shstrtab->sh_size());
+    }
+    for(size_t i = 0; i < elf.e_shnum(); ++i){
+        const auto &shdr = elf.shdr(i);
+        if(shdr->sh_type().value() == SHT_NOTE || elf.get_sh_name(i) == ".GCC.command.line")
+            fill(fd.get(), buf, size, shdr->sh_offset(), shdr->sh_size());
+    }
+    for(size_t i = 0; i < elf.e_phnum(); ++i){
+        const auto &phdr = elf.phdr(i);
+        if(phdr->p_type().value() == PT_NOTE)
+            fill(fd.get(), buf, size, phdr->p_offset(), phdr->p_filesz());
+    }
+
+    return makeSummary(elf);
+}
+
+bool FileIndex::update(const string &path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)){
+        remove(path);
+        return false;
+    }
+
+    const int64_t mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if(it != entries_.end() && it->second.ino == st.st_ino &&
+                it->second.size == (uint64_t)st.st_size && it->second.mtime_ns == mtime_ns)
+            return false;
+    }
+
+    Entry entry{(uint64_t)st.st_ino, (uint64_t)st.st_size, mtime_ns, FileSummary()};
+    try{
+        entry.summary = readSummary(path);
+    }catch(std::exception&){
+        // not an ELF file, or it went away while we were reading it
+        remove(path);
+        return true;
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    entries_[path] = move(entry);
+    return true;
+}
+
+void FileIndex::remove(const string &path)
+{
+    lock_guard<mutex> lock(mutex_);
+    auto it = entries_.lower_bound(path);
+    if(it != entries_.end() && it->first == path)
+        it = entries_.erase(it);
+    while(it != entries_.end() && isBelow(it->first, path))
+        it = entries_.erase(it);
+}
+
+void FileIndex::prune()
+{
+    lock_guard<mutex> lock(mutex_);
+    for(auto it = entries_.begin(); it != entries_.end(); ){
+        struct stat st;
+        if(stat(it->first.c_str(), &st) < 0)
+            it = entries_.erase(it);
+        else
+            ++it;
+    }
+}
+
+size_t FileIndex::size() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void FileIndex::dump(ostream &os) const
+{
+    lock_guard<mutex> lock(mutex_);
+    for(const auto &kv: entries_){
+        const FileSummary &summary = kv.second.summary;
+        os << kv.first << endl;
+        os << "  ELF Type: " << summary.type << endl;
+        os << "  Build ID: " << (summary.build_id.empty() ? "N/A" : summary.build_id) << endl;
+
+        if(summary.gcc_args.empty())
+            os << "  Gcc Args: N/A" << endl;
+        else{
+            os << "  Gcc Args:";
+            for(const auto &arg: summary.gcc_args)
+                os << " " << arg;
+            os << endl;
+        }
+
+        os << "  Layout:" << endl;
+        for(const auto &item: summary.layout)
+            os << "    " << Addr(item.first) << " " << item.second << endl;
+    }
+    os << "# " << entries_.size() << " files" << endl;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Watcher::Watcher(FileIndex &index, int debounce_ms)
+    :index_(index), fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+     debounce_(debounce_ms), rescan_(false)
+{
+    if(fd_ < 0)
+        throw std::system_error(errno, std::generic_category(), "inotify_init1");
+}
+
+Watcher::~Watcher()
+{
+    close(fd_);
+}
+
+void Watcher::watch_dir(const string &dir)
+{
+    namespace fs = std::filesystem;
+
+    vector<string> dirs{dir};
+    std::error_code ec;
+    auto it = fs::recursive_directory_iterator(dir,
+            fs::directory_options::skip_permission_denied, ec);
+    for(; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)){
+        if(it->is_directory(ec) && !it->is_symlink(ec))
+            dirs.push_back(it->path().string());
+    }
+
+    for(const auto &d: dirs){
+        int wd = inotify_add_watch(fd_, d.c_str(), WATCH_MASK | IN_ONLYDIR);
+        if(wd < 0){
+            if(errno == ENOSPC)
+                cerr << d << ": inotify watch limit reached" << endl;
+            continue;
+        }
+        dirs_[wd] = d;
+    }
+}
+
+void Watcher::unwatch_below(const string &dir)
+{
+    for(auto it = dirs_.begin(); it != dirs_.end(); ){
+        if(it->second == dir || isBelow(it->second, dir)){
+            inotify_rm_watch(fd_, it->first);
+            it = dirs_.erase(it);
+        }else
+            ++it;
+    }
+}
+
+void Watcher::add_tree(const string &dir)
+{
+    roots_.push_back(dir);
+    watch_dir(dir);
+
+    vector<string> files = listFiles(vector<string>{dir});
+    parallelFor(files.size(), [&](size_t i){ index_.update(files[i]); });
+}
+
+void Watcher::read_events()
+{
+    alignas(struct inotify_event) char buf[64 * 1024];
+
+    for(;;){
+        ssize_t len = read(fd_, buf, sizeof(buf));
+        if(len <= 0)
+            break;
+
+        auto now = chrono::steady_clock::now();
+        if(pending_.empty() && !rescan_)
+            first_event_ = now;
+        last_event_ = now;
+
+        for(char *p = buf; p < buf + len; ){
+            const struct inotify_event *ev = (const struct inotify_event*) p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if(ev->mask & IN_Q_OVERFLOW){
+                rescan_ = true;
+                continue;
+            }
+
+            auto it = dirs_.find(ev->wd);
+            if(it == dirs_.end())
+                continue;
+            if(ev->mask & IN_IGNORED){
+                dirs_.erase(it);
+                continue;
+            }
+            if(ev->len == 0)
+                continue;
+
+            const string path = it->second + "/" + ev->name;
+            if(ev->mask & IN_ISDIR){
+                if(ev->mask & (IN_CREATE | IN_MOVED_TO)){
+                    watch_dir(path);
+                    for(const auto &file: listFiles(vector<string>{path}))
+                        pending_[file] = false;
+                }else if(ev->mask & (IN_DELETE | IN_MOVED_FROM)){
+                    unwatch_below(path);
+                    pending_[path] = true;
+                }
+            }else if(ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)){
+                pending_[path] = false;
+            }else if(ev->mask & (IN_DELETE | IN_MOVED_FROM)){
+                pending_[path] = true;
+            }
+        }
+    }
+}
+
+void Watcher::flush()
+{
+    if(rescan_){
+        // events were lost; fall back to a full (stamp-checked) pass
+        rescan_ = false;
+        pending_.clear();
+        index_.prune();
+        for(const auto &root: roots_)
+            for(const auto &file: listFiles(vector<string>{root}))
+                pending_[file] = false;
+    }
+
+    vector<string> changed;
+    size_t removed = 0;
+    for(const auto &kv: pending_){
+        if(kv.second){
+            index_.remove(kv.first);
+            ++removed;
+        }else
+            changed.push_back(kv.first);
+    }
+    pending_.clear();
+
+    std::atomic<size_t> parsed{0};
+    parallelFor(changed.size(), [&](size_t i){
+        if(index_.update(changed[i]))
+            ++parsed;
+    });
+
+    cerr << "watch: " << parsed << " parsed, " << removed << " removed, "
+         << index_.size() << " indexed" << endl;
+}
+
+void Watcher::run(ostream &os)
+{
+    string line;
+    bool commands = true;   // stdin still open
+    for(;;){
+        int timeout = -1;
+        if(!pending_.empty() || rescan_){
+            auto now = chrono::steady_clock::now();
+            auto deadline = std::min(last_event_ + debounce_, first_event_ + 10 * debounce_);
+            if(now >= deadline){
+                flush();
+                continue;
+            }
+            timeout = chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1;
+        }
+
+        struct pollfd fds[2] = {{fd_, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        if(poll(fds, commands ? 2 : 1, timeout) < 0){
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "poll");
+        }
+
+        if(fds[0].revents & POLLIN)
+            read_events();
+
+        if(commands && (fds[1].revents & POLLNVAL))
+            commands = false;
+        if(commands && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))){
+            char buf[256];
+            ssize_t len = read(STDIN_FILENO, buf, sizeof(buf));
+            if(len < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if(len <= 0){
+                // no more commands; keep watching
+                commands = false;
+                continue;
+            }
+            line.append(buf, len);
+
+            size_t nl;
+            while((nl = line.find('\n')) != string::npos){
+                string cmd = line.substr(0, nl);
+                line.erase(0, nl + 1);
+                if(cmd == "dump"){
+                    if(!pending_.empty() || rescan_)
+                        flush();
+                    index_.dump(os);
+                    os.flush();
+                }else if(cmd == "quit")
+                    return;
+            }
+        }
+    }
+}
+
+} //namespace end
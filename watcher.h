@@ -0,0 +1,85 @@
+#ifndef __WATCHER_H
+#define __WATCHER_H 1
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "summary.h"
+
+namespace iii{
+
+// In-memory index of per-file summaries, safe to update from many threads.
+class FileIndex{
+public:
+    // (Re)parse `path` unless its inode, size and mtime are unchanged.
+    // Files that are gone or are not ELF are dropped from the index.
+    // Returns true if the file was parsed.
+    bool update(const string &path);
+
+    // drop `path` and, if it was a directory, everything below it
+    void remove(const string &path);
+
+    // drop the entries whose file no longer exists
+    void prune();
+
+    size_t size() const;
+    void dump(ostream &os) const;
+
+private:
+    struct Entry{
+        uint64_t ino;
+        uint64_t size;
+        int64_t mtime_ns;
+        FileSummary summary;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<string, Entry> entries_;
+};
+
+// Keeps a FileIndex current from inotify events on whole directory trees.
+//
+// Events are coalesced per path and applied once the trees have been quiet
+// for `debounce_ms` (or after ten times that under a steady stream), so a
+// file rewritten many times by a build is parsed once.
+class Watcher{
+public:
+    Watcher(FileIndex &index, int debounce_ms = 200);
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // watch every directory below `dir` and index the files already there
+    void add_tree(const string &dir);
+
+    // Process events until "quit" on stdin (or a signal); "dump" on stdin
+    // prints the index to `os`. EOF on stdin (nohup, < /dev/null) only
+    // stops reading commands.
+    void run(ostream &os);
+
+private:
+    void watch_dir(const string &dir);
+    void unwatch_below(const string &dir);
+    void read_events();
+    void flush();
+
+    FileIndex &index_;
+    int fd_;
+    std::chrono::milliseconds debounce_;
+
+    vector<string> roots_;
+    std::unordered_map<int, string> dirs_;     // watch descriptor -> directory
+    std::map<string, bool> pending_;           // path -> removed
+    bool rescan_;
+    std::chrono::steady_clock::time_point first_event_;
+    std::chrono::steady_clock::time_point last_event_;
+};
+
+} //namespace end
+
+#endif